@@ -13,12 +13,11 @@ __FBSDID("$FreeBSD$");
 #include <sys/sysctl.h>
 
 #include <err.h>
-#ifdef __APPLE__
 #include <errno.h>
-#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #ifdef __APPLE__
 /* Removes the legacy Num field. */
@@ -55,6 +54,9 @@ static struct flaglist {
 };
 
 static const char *fmt_flags(int);
+#ifndef __APPLE__
+static struct xvfsconf *getconflist(size_t *);
+#endif
 
 int
 main(int argc, char **argv)
@@ -118,13 +120,7 @@ main(int argc, char **argv)
 			}
 		}
 #else
-		if (sysctlbyname("vfs.conflist", NULL, &buflen, NULL, 0) < 0)
-			err(1, "sysctl(vfs.conflist)");
-		xvfsp = malloc(buflen);
-		if (xvfsp == NULL)
-			errx(1, "malloc failed");
-		if (sysctlbyname("vfs.conflist", xvfsp, &buflen, NULL, 0) < 0)
-			err(1, "sysctl(vfs.conflist)");
+		xvfsp = getconflist(&buflen);
 		cnt = buflen / sizeof(struct xvfsconf);
 
 		for (i = 0; i < cnt; i++) {
@@ -139,6 +135,39 @@ main(int argc, char **argv)
 	return (rv);
 }
 
+#ifndef __APPLE__
+/*
+ * Read vfs.conflist into a buffer with room for a few more entries, and
+ * size it again if a file system was loaded in between.
+ */
+static struct xvfsconf *
+getconflist(size_t *buflenp)
+{
+	struct xvfsconf *xvfsp;
+	size_t buflen, want;
+	int retry;
+
+	xvfsp = NULL;
+	for (retry = 0; ; retry++) {
+		if (sysctlbyname("vfs.conflist", NULL, &buflen, NULL, 0) < 0)
+			err(1, "sysctl(vfs.conflist)");
+		want = buflen + 4 * sizeof(struct xvfsconf);
+		free(xvfsp);
+		if ((xvfsp = malloc(want)) == NULL)
+			errx(1, "malloc failed");
+		buflen = want;
+		if (sysctlbyname("vfs.conflist", xvfsp, &buflen, NULL, 0) == 0)
+			break;
+		if (errno != ENOMEM || retry == 100)
+			err(1, "sysctl(vfs.conflist)");
+		/* Brief, growing pause, in case modules are being loaded. */
+		(void)usleep(10 << (retry < 10 ? retry : 10));
+	}
+	*buflenp = buflen;
+	return (xvfsp);
+}
+#endif
+
 static const char *
 fmt_flags(int flags)
 {
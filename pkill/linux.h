@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * FreeBSD-shaped process structure for the Linux /proc source (procfs.c).
+ *
+ * pkill.c selects and reports processes through the kinfo_proc fields
+ * that kvm_getprocs(3) fills in on FreeBSD.  Linux has no such
+ * structure, so provide just the fields pkill looks at.
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/sysmacros.h>
+#include <sys/time.h>
+
+#ifndef MAXCOMLEN
+#define	MAXCOMLEN	16
+#endif
+
+/* Only used if sysconf(_SC_ARG_MAX) fails; the limit is not fixed. */
+#ifndef ARG_MAX
+#define	ARG_MAX		131072
+#endif
+
+#ifndef NODEV
+#define	NODEV		((dev_t)-1)
+#endif
+
+#define	P_CONTROLT	0x00000002	/* Has a controlling terminal. */
+#define	P_KPROC		0x00000004	/* Kernel thread. */
+
+struct kinfo_proc {
+	pid_t	ki_pid;
+	pid_t	ki_ppid;
+	pid_t	ki_pgid;
+	pid_t	ki_sid;
+	uid_t	ki_ruid;
+	uid_t	ki_uid;			/* effective */
+	gid_t	ki_rgid;
+	dev_t	ki_tdev;
+	int	ki_flag;		/* P_* */
+	struct	timeval ki_start;
+	char	ki_comm[MAXCOMLEN + 1];
+};
+
+/* procfs_getprocs() flags */
+#define	PROCFS_CREDS	0x01		/* Fill in ki_ruid, ki_uid, ki_rgid. */
+
+struct kinfo_proc *procfs_getprocs(pid_t, int, int *);
+char	**procfs_getargv(const struct kinfo_proc *);
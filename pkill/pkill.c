@@ -37,15 +37,20 @@ __FBSDID("$FreeBSD$");
 
 #include <sys/types.h>
 #include <sys/param.h>
+#ifndef __linux__
 #include <sys/sysctl.h>
 #include <sys/proc.h>
+#endif /* !__linux__ */
 #include <sys/queue.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#ifndef __linux__
 #include <sys/user.h>
+#endif /* !__linux__ */
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
@@ -56,17 +61,21 @@ __FBSDID("$FreeBSD$");
 #include <regex.h>
 #include <ctype.h>
 #include <fcntl.h>
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 #include <kvm.h>
-#endif
+#endif /* !__APPLE__ && !__linux__ */
 #include <err.h>
 #include <pwd.h>
 #include <grp.h>
 #include <errno.h>
 #include <locale.h>
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 #include <jail.h>
-#endif
+#endif /* !__APPLE__ && !__linux__ */
+
+#ifdef __linux__
+#include "linux.h"
+#endif /* __linux__ */
 
 #ifdef __APPLE__
 #include <xpc/xpc.h>
@@ -81,7 +90,11 @@ __FBSDID("$FreeBSD$");
 #define	STATUS_ERROR	3
 
 #define	MIN_PID	5
+#ifdef __linux__
+#define	MAX_PID	INT_MAX		/* kernel.pid_max can go up to 2^22 */
+#else
 #define	MAX_PID	99999
+#endif
 
 #ifdef __APPLE__
 /* Ignore system processes and myself. */
@@ -100,8 +113,10 @@ enum listtype {
 	LT_TTY,
 	LT_PGRP,
 #ifndef __APPLE__
-	LT_JAIL,
 	LT_SID,
+#endif
+#if !defined(__APPLE__) && !defined(__linux__)
+	LT_JAIL,
 	LT_CLASS
 #endif
 };
@@ -114,6 +129,18 @@ struct list {
 
 SLIST_HEAD(listhead, list);
 
+/*
+ * A list of numbers, once complete, as an open-addressing hash set of
+ * li_number; see hashlist().
+ */
+struct listset {
+	uint64_t	*ls_hash;	/* NULL if the list is empty */
+	int		 ls_shift;	/* 64 - log2(slots) */
+	int		 ls_full;	/* HASH_EMPTY itself is in the list */
+};
+
+#define	HASH_EMPTY	UINT64_MAX	/* unused hash slot */
+
 #ifdef __APPLE__
 static sysmon_table_t plist;
 #else
@@ -128,6 +155,7 @@ static int	newest;
 static int	oldest;
 static int	interactive;
 static int	inverse;
+static int	subtree;
 static int	longfmt;
 static int	matchargs;
 static int	fullmatch;
@@ -136,11 +164,30 @@ static int	kthreads;
 #endif
 static int	cflags = REG_EXTENDED;
 static int	quiet;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 static kvm_t	*kd;
 #endif
 static pid_t	mypid;
 
+/*
+ * A pattern argument.  Patterns without regular expression syntax are
+ * looked for as plain strings; see patcompile().
+ */
+struct pattern {
+	const char	*pat_text;
+	size_t		 pat_len;
+	int		 pat_literal;
+	size_t		 pat_group;	/* its subexpression in patall */
+	regex_t		 pat_reg;
+};
+
+static struct pattern *pats;
+static int	npats;
+static regex_t	patall;		/* all the other patterns, or-ed */
+static int	havepatall;
+static regmatch_t *patmatches;
+static size_t	npatmatches;
+
 static struct listhead euidlist = SLIST_HEAD_INITIALIZER(euidlist);
 static struct listhead ruidlist = SLIST_HEAD_INITIALIZER(ruidlist);
 static struct listhead rgidlist = SLIST_HEAD_INITIALIZER(rgidlist);
@@ -149,21 +196,69 @@ static struct listhead ppidlist = SLIST_HEAD_INITIALIZER(ppidlist);
 static struct listhead tdevlist = SLIST_HEAD_INITIALIZER(tdevlist);
 #ifndef __APPLE__
 static struct listhead sidlist = SLIST_HEAD_INITIALIZER(sidlist);
+#endif
+#if !defined(__APPLE__) && !defined(__linux__)
 static struct listhead jidlist = SLIST_HEAD_INITIALIZER(jidlist);
 static struct listhead classlist = SLIST_HEAD_INITIALIZER(classlist);
 #endif
 
+static struct listset euidset;
+static struct listset ruidset;
+static struct listset rgidset;
+static struct listset pgrpset;
+static struct listset ppidset;
+static struct listset tdevset;
+#ifndef __APPLE__
+static struct listset sidset;
+#endif
+
+/*
+ * The process table indexed by pid: an open-addressing hash of pid to
+ * row, built once per snapshot by pidindex_build().
+ */
+struct pidslot {
+	pid_t	ps_pid;
+	int	ps_row;			/* -1 if the slot is unused */
+};
+
+static struct pidslot *pidindex;
+static int	pidshift;		/* 64 - log2(slots) */
+
 static void	usage(void) __attribute__((__noreturn__));
 #ifdef __APPLE__
 static int	killact(const sysmon_row_t);
 static int	grepact(const sysmon_row_t);
+static int	procfilter(const sysmon_row_t, pid_t);
 #else
 static int	killact(const struct kinfo_proc *);
 static int	grepact(const struct kinfo_proc *);
+static int	procfilter(const struct kinfo_proc *, pid_t);
 #endif
+static void	hashlist(struct listset *, struct listhead *, enum listtype);
+static int	in_set(const struct listset *, uint64_t);
+static void	pidindex_build(void);
+static int	pidindex_find(pid_t);
+static int	*selecttree(void);
 static void	makelist(struct listhead *, enum listtype, char *);
+static void	patcompile(char **, int);
+static void	patfree(void);
+static int	patmatch(const char *);
+static void	regfail(int, const regex_t *) __attribute__((__noreturn__));
 static int	takepid(const char *, int);
 
+#ifdef __linux__
+/* glibc has no sys_signame[]; realtime signals have no name. */
+static const char *
+signame(int sig)
+{
+	const char *name;
+
+	return ((name = sigabbrev_np(sig)) != NULL ? name : "");
+}
+#else
+#define	signame(sig)	(sys_signame[(sig)])
+#endif
+
 #ifdef __APPLE__
 static sysmon_table_t
 copy_process_info(void)
@@ -209,11 +304,16 @@ main(int argc, char **argv)
 	xpc_object_t pargv;
 #else
 	char *buf, *mstr, **pargv, *p, *q, *pidfile;
+#ifdef __linux__
+	int procflags;
+#else
 	const char *execf, *coref;
+#endif
 #endif
 	size_t bufsz;
 	int ancestors, debug_opt, did_action;
-	int i, ch, bestidx, rv, criteria, pidfromfile, pidfilelock;
+	int i, j, ch, bestidx, rv, criteria, pidfromfile, pidfilelock;
+	int *order;
 #ifdef __APPLE__
 	__block size_t jsz;
 	int (*action)(const sysmon_row_t);
@@ -223,14 +323,11 @@ main(int argc, char **argv)
 	int (*action)(const struct kinfo_proc *);
 	struct kinfo_proc *kp;
 #endif
-	struct list *li;
 #ifdef __APPLE__
 	int64_t best_tval;
 #else
 	struct timeval best_tval;
 #endif
-	regex_t reg;
-	regmatch_t regmatch;
 	pid_t pid;
 
 	setlocale(LC_ALL, "");
@@ -253,7 +350,7 @@ main(int argc, char **argv)
 				if (strncasecmp(p, "SIG", 3) == 0)
 					p += 3;
 				for (i = 1; i < NSIG; i++)
-					if (strcasecmp(sys_signame[i], p) == 0)
+					if (strcasecmp(signame(i), p) == 0)
 						break;
 				if (i != NSIG) {
 					signum = i;
@@ -271,15 +368,17 @@ main(int argc, char **argv)
 	pidfile = NULL;
 	pidfilelock = 0;
 	quiet = 0;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 	execf = NULL;
 	coref = _PATH_DEVNULL;
 #endif
 
 #ifdef __APPLE__
-	while ((ch = getopt(argc, argv, "DF:G:ILP:U:ac:d:fg:ilnoqt:u:vx")) != -1)
+	while ((ch = getopt(argc, argv, "DF:G:ILP:TU:ac:d:fg:ilnoqt:u:vx")) != -1)
+#elif defined(__linux__)
+	while ((ch = getopt(argc, argv, "DF:G:ILP:STU:ad:fg:ilnoqs:t:u:vx")) != -1)
 #else
-	while ((ch = getopt(argc, argv, "DF:G:ILM:N:P:SU:ac:d:fg:ij:lnoqs:t:u:vx")) != -1)
+	while ((ch = getopt(argc, argv, "DF:G:ILM:N:P:STU:ac:d:fg:ij:lnoqs:t:u:vx")) != -1)
 #endif
 		switch (ch) {
 		case 'D':
@@ -301,7 +400,7 @@ main(int argc, char **argv)
 		case 'L':
 			pidfilelock = 1;
 			break;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 		case 'M':
 			coref = optarg;
 			break;
@@ -320,6 +419,9 @@ main(int argc, char **argv)
 			kthreads = 1;
 			break;
 #endif
+		case 'T':
+			subtree = 1;
+			break;
 		case 'U':
 			makelist(&ruidlist, LT_USER, optarg);
 			criteria = 1;
@@ -327,7 +429,7 @@ main(int argc, char **argv)
 		case 'a':
 			ancestors++;
 			break;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 		case 'c':
 			makelist(&classlist, LT_CLASS, optarg);
 			criteria = 1;
@@ -348,7 +450,7 @@ main(int argc, char **argv)
 		case 'i':
 			cflags |= REG_ICASE;
 			break;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 		case 'j':
 			makelist(&jidlist, LT_JAIL, optarg);
 			criteria = 1;
@@ -445,6 +547,19 @@ main(int argc, char **argv)
 		errx(STATUS_ERROR, "Cannot get process list");
 	}
 	nproc = sysmon_table_get_count(plist);
+#elif defined(__linux__)
+	/*
+	 * Read the credentials only if something is going to look at them;
+	 * everything else comes from /proc/<pid>/stat.
+	 */
+	procflags = 0;
+	if (SLIST_FIRST(&ruidlist) != NULL || SLIST_FIRST(&rgidlist) != NULL ||
+	    SLIST_FIRST(&euidlist) != NULL || debug_opt > 0)
+		procflags |= PROCFS_CREDS;
+	/* -T needs the whole table to find the descendants. */
+	plist = procfs_getprocs(subtree ? -1 : pidfromfile, procflags, &nproc);
+	if (plist == NULL)
+		err(STATUS_ERROR, "Cannot get process list");
 #else
 	/*
 	 * Retrieve the list of running processes from the kernel.
@@ -457,7 +572,7 @@ main(int argc, char **argv)
 	 * Use KERN_PROC_PROC instead of KERN_PROC_ALL, since we
 	 * just want processes and not individual kernel threads.
 	 */
-	if (pidfromfile >= 0)
+	if (pidfromfile >= 0 && !subtree)
 		plist = kvm_getprocs(kd, KERN_PROC_PID, pidfromfile, &nproc);
 	else
 		plist = kvm_getprocs(kd, KERN_PROC_PROC, 0, &nproc);
@@ -478,131 +593,22 @@ main(int argc, char **argv)
 	memset(selected, 0, nproc);
 
 	/*
-	 * Refine the selection.
+	 * Select the processes in one pass over the table.  The integer
+	 * criteria are tested first, each with one hash probe; only the
+	 * processes that pass them all have their argument list assembled
+	 * and matched against the patterns.
 	 */
-	for (; *argv != NULL; argv++) {
-		if ((rv = regcomp(&reg, *argv, cflags)) != 0) {
-			regerror(rv, &reg, buf, bufsz);
-			errx(STATUS_BADUSAGE,
-			    "Cannot compile regular expression `%s' (%s)",
-			    *argv, buf);
-		}
-
-#ifdef __APPLE__
-		for (i = 0; i < nproc; i++) {
-			kp = sysmon_table_get_row(plist, i);
-#else
-		for (i = 0, kp = plist; i < nproc; i++, kp++) {
-#endif
-			if (PSKIP(kp)) {
-				if (debug_opt > 0)
-				    fprintf(stderr, "* Skipped %5d %3d %s\n",
-#ifdef __APPLE__
-					(pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID)),
-					(uid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_UID)),
-					xpc_string_get_string_ptr(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_COMM)));
-#else
-					kp->ki_pid, kp->ki_uid, kp->ki_comm);
-#endif
-				continue;
-			}
-
-#ifdef __APPLE__
-			if (matchargs &&
-			    (pargv = sysmon_row_get_value(kp, SYSMON_ATTR_PROC_ARGUMENTS)) != NULL) {
-				jsz = 0;
-				os_assert(bufsz >= _POSIX2_LINE_MAX);
-				bufp = buf;
-				xpc_array_apply(pargv, ^(size_t index, xpc_object_t value) {
-					if (jsz >= bufsz) {
-						return (bool)false;
-					}
-					jsz += snprintf(bufp + jsz,
-					    bufsz - jsz,
-					    index < xpc_array_get_count(pargv) - 1 ? "%s " : "%s",
-					    xpc_string_get_string_ptr(value));
-					return (bool)true;
-				});
-#else
-			if (matchargs &&
-			    (pargv = kvm_getargv(kd, kp, 0)) != NULL) {
-				jsz = 0;
-				while (jsz < bufsz && *pargv != NULL) {
-					jsz += snprintf(buf + jsz,
-					    bufsz - jsz,
-					    pargv[1] != NULL ? "%s " : "%s",
-					    pargv[0]);
-					pargv++;
-				}
-#endif
-				mstr = buf;
-			} else
-#ifdef __APPLE__
-			{
-				/*
-				 * comm is limited to 15 bytes (MAXCOMLEN - 1).
-				 * Try to use argv[0] (trimmed) if available.
-				 */
-				mstr = NULL;
-				pargv = sysmon_row_get_value(kp, SYSMON_ATTR_PROC_ARGUMENTS);
-				if (pargv != NULL && xpc_array_get_count(pargv) > 0) {
-					const char *tmp = xpc_array_get_string(pargv, 0);
-					if (tmp != NULL) {
-						mstr = strrchr(tmp, '/');
-						if (mstr != NULL) {
-							mstr++;
-						} else {
-							mstr = (char *)tmp;
-						}
-					}
-				}
-
-				/* Fall back to "comm" if we failed to get argv[0]. */
-				if (mstr == NULL || *mstr == '\0') {
-					mstr = (char *)xpc_string_get_string_ptr(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_COMM));
-				}
-
-				/* Couldn't find process name, it probably exited. */
-				if (mstr == NULL) {
-					continue;
-				}
-			}
-#else
-				mstr = kp->ki_comm;
+	hashlist(&ruidset, &ruidlist, LT_USER);
+	hashlist(&rgidset, &rgidlist, LT_GROUP);
+	hashlist(&euidset, &euidlist, LT_USER);
+	hashlist(&ppidset, &ppidlist, LT_GENERIC);
+	hashlist(&pgrpset, &pgrplist, LT_PGRP);
+	hashlist(&tdevset, &tdevlist, LT_TTY);
+#ifndef __APPLE__
+	hashlist(&sidset, &sidlist, LT_SID);
 #endif
-
-			rv = regexec(&reg, mstr, 1, &regmatch, 0);
-			if (rv == 0) {
-				if (fullmatch) {
-					if (regmatch.rm_so == 0 &&
-					    regmatch.rm_eo ==
-					    (off_t)strlen(mstr))
-						selected[i] = 1;
-				} else
-					selected[i] = 1;
-			} else if (rv != REG_NOMATCH) {
-				regerror(rv, &reg, buf, bufsz);
-				errx(STATUS_ERROR,
-				    "Regular expression evaluation error (%s)",
-				    buf);
-			}
-			if (debug_opt > 1) {
-				const char *rv_res = "NoMatch";
-				if (selected[i])
-					rv_res = "Matched";
-				fprintf(stderr, "* %s %5d %3d %s\n", rv_res,
-#ifdef __APPLE__
-				    (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID)),
-				    (uid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_UID)),
-				    mstr);
-#else
-				    kp->ki_pid, kp->ki_uid, mstr);
-#endif
-			}
-		}
-
-		regfree(&reg);
-	}
+	if (argc > 0)
+		patcompile(argv, argc);
 
 #ifdef __APPLE__
 	for (i = 0; i < nproc; i++) {
@@ -610,169 +616,133 @@ main(int argc, char **argv)
 #else
 	for (i = 0, kp = plist; i < nproc; i++, kp++) {
 #endif
-		if (PSKIP(kp))
-			continue;
-
+		if (PSKIP(kp)) {
+			if (debug_opt > 0)
+			    fprintf(stderr, "* Skipped %5d %3d %s\n",
 #ifdef __APPLE__
-		if (pidfromfile >= 0 && (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID)) != pidfromfile) {
+				(pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID)),
+				(uid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_UID)),
+				xpc_string_get_string_ptr(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_COMM)));
 #else
-		if (pidfromfile >= 0 && kp->ki_pid != pidfromfile) {
+				kp->ki_pid, kp->ki_uid, kp->ki_comm);
 #endif
-			selected[i] = 0;
 			continue;
 		}
 
-		SLIST_FOREACH(li, &ruidlist, li_chain)
-#ifdef __APPLE__
-			if ((uid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_RUID)) == (uid_t)li->li_number)
-#else
-			if (kp->ki_ruid == (uid_t)li->li_number)
-#endif
-				break;
-		if (SLIST_FIRST(&ruidlist) != NULL && li == NULL) {
-			selected[i] = 0;
+		if (!procfilter(kp, pidfromfile))
 			continue;
-		}
-
-		SLIST_FOREACH(li, &rgidlist, li_chain)
-#ifdef __APPLE__
-			if ((gid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_RGID)) == (gid_t)li->li_number)
-#else
-			if (kp->ki_rgid == (gid_t)li->li_number)
-#endif
-				break;
-		if (SLIST_FIRST(&rgidlist) != NULL && li == NULL) {
-			selected[i] = 0;
+		if (argc == 0) {
+			selected[i] = 1;
 			continue;
 		}
 
-		SLIST_FOREACH(li, &euidlist, li_chain)
 #ifdef __APPLE__
-			if ((uid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_UID)) == (uid_t)li->li_number)
+		if (matchargs &&
+		    (pargv = sysmon_row_get_value(kp, SYSMON_ATTR_PROC_ARGUMENTS)) != NULL) {
+			jsz = 0;
+			os_assert(bufsz >= _POSIX2_LINE_MAX);
+			bufp = buf;
+			xpc_array_apply(pargv, ^(size_t index, xpc_object_t value) {
+				if (jsz >= bufsz) {
+					return (bool)false;
+				}
+				jsz += snprintf(bufp + jsz,
+				    bufsz - jsz,
+				    index < xpc_array_get_count(pargv) - 1 ? "%s " : "%s",
+				    xpc_string_get_string_ptr(value));
+				return (bool)true;
+			});
 #else
-			if (kp->ki_uid == (uid_t)li->li_number)
-#endif
-				break;
-		if (SLIST_FIRST(&euidlist) != NULL && li == NULL) {
-			selected[i] = 0;
-			continue;
-		}
-
-		SLIST_FOREACH(li, &ppidlist, li_chain)
-#ifdef __APPLE__
-			if ((pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PPID)) == (pid_t)li->li_number)
+		if (matchargs &&
+#ifdef __linux__
+		    (pargv = procfs_getargv(kp)) != NULL) {
 #else
-			if (kp->ki_ppid == (pid_t)li->li_number)
+		    (pargv = kvm_getargv(kd, kp, 0)) != NULL) {
 #endif
-				break;
-		if (SLIST_FIRST(&ppidlist) != NULL && li == NULL) {
-			selected[i] = 0;
-			continue;
-		}
-
-		SLIST_FOREACH(li, &pgrplist, li_chain)
-#ifdef __APPLE__
-			if ((pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PGID)) == (pid_t)li->li_number)
-#else
-			if (kp->ki_pgid == (pid_t)li->li_number)
+			jsz = 0;
+			while (jsz < bufsz && *pargv != NULL) {
+				jsz += snprintf(buf + jsz,
+				    bufsz - jsz,
+				    pargv[1] != NULL ? "%s " : "%s",
+				    pargv[0]);
+				pargv++;
+			}
 #endif
-				break;
-		if (SLIST_FIRST(&pgrplist) != NULL && li == NULL) {
-			selected[i] = 0;
-			continue;
-		}
-
-		SLIST_FOREACH(li, &tdevlist, li_chain) {
-			if (li->li_number == -1 &&
+			mstr = buf;
+		} else
 #ifdef __APPLE__
-			    (xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_FLAGS)) & PROC_FLAG_CONTROLT) == 0)
+		{
+			/*
+			 * comm is limited to 15 bytes (MAXCOMLEN - 1).
+			 * Try to use argv[0] (trimmed) if available.
+			 */
+			mstr = NULL;
+			pargv = sysmon_row_get_value(kp, SYSMON_ATTR_PROC_ARGUMENTS);
+			if (pargv != NULL && xpc_array_get_count(pargv) > 0) {
+				const char *tmp = xpc_array_get_string(pargv, 0);
+				if (tmp != NULL) {
+					mstr = strrchr(tmp, '/');
+					if (mstr != NULL) {
+						mstr++;
+					} else {
+						mstr = (char *)tmp;
+					}
+				}
+			}
+
+			/* Fall back to "comm" if we failed to get argv[0]. */
+			if (mstr == NULL || *mstr == '\0') {
+				mstr = (char *)xpc_string_get_string_ptr(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_COMM));
+			}
+
+			/* Couldn't find process name, it probably exited. */
+			if (mstr == NULL) {
+				continue;
+			}
+		}
 #else
-			    (kp->ki_flag & P_CONTROLT) == 0)
+			mstr = kp->ki_comm;
 #endif
-				break;
+
+		if ((rv = patmatch(mstr)) >= 0)
+			selected[i] = 1;
+		if (debug_opt > 1) {
+			const char *rv_res = "NoMatch";
+			if (selected[i])
+				rv_res = "Matched";
+			fprintf(stderr, "* %s %5d %3d %s%s%s\n", rv_res,
 #ifdef __APPLE__
-			if ((dev_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_TDEV)) == (dev_t)li->li_number)
+			    (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID)),
+			    (uid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_UID)),
 #else
-			if (kp->ki_tdev == (dev_t)li->li_number)
+			    kp->ki_pid, kp->ki_uid,
 #endif
-				break;
+			    mstr, rv >= 0 ? " by " : "",
+			    rv >= 0 ? argv[rv] : "");
 		}
-		if (SLIST_FIRST(&tdevlist) != NULL && li == NULL) {
-			selected[i] = 0;
-			continue;
-		}
-
-#ifndef __APPLE__
-		SLIST_FOREACH(li, &sidlist, li_chain)
-			if (kp->ki_sid == (pid_t)li->li_number)
-				break;
-		if (SLIST_FIRST(&sidlist) != NULL && li == NULL) {
-			selected[i] = 0;
-			continue;
-		}
-
-		SLIST_FOREACH(li, &jidlist, li_chain) {
-			/* A particular jail ID, including 0 (not in jail) */
-			if (kp->ki_jid == (int)li->li_number)
-				break;
-			/* Any jail */
-			if (kp->ki_jid > 0 && li->li_number == -1)
-				break;
-		}
-		if (SLIST_FIRST(&jidlist) != NULL && li == NULL) {
-			selected[i] = 0;
-			continue;
-		}
-
-		SLIST_FOREACH(li, &classlist, li_chain) {
-			/*
-			 * We skip P_SYSTEM processes to match ps(1) output.
-			 */
-			if ((kp->ki_flag & P_SYSTEM) == 0 &&
-			    strcmp(kp->ki_loginclass, li->li_name) == 0)
-				break;
-		}
-		if (SLIST_FIRST(&classlist) != NULL && li == NULL) {
-			selected[i] = 0;
-			continue;
-		}
-#endif /* !__APPLE__ */
-
-		if (argc == 0)
-			selected[i] = 1;
 	}
 
+	if (argc > 0)
+		patfree();
+
 	if (!ancestors) {
+		pidindex_build();
 		pid = mypid;
 		while (pid) {
-#ifdef __APPLE__
-			for (i = 0; i < nproc; i++) {
-				kp = sysmon_table_get_row(plist, i);
-#else
-			for (i = 0, kp = plist; i < nproc; i++, kp++) {
-#endif
-				if (PSKIP(kp))
-					continue;
-#ifdef __APPLE__
-				if ((pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID)) == pid) {
-					selected[i] = 0;
-					pid = (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PPID));
-					break;
-				}
-#else
-				if (kp->ki_pid == pid) {
-					selected[i] = 0;
-					pid = kp->ki_ppid;
-					break;
-				}
-#endif
-			}
-			if (i == nproc) {
+			if ((i = pidindex_find(pid)) == -1) {
 				if (pid == mypid)
 					pid = getppid();
 				else
 					break;	/* Maybe we're in a jail ? */
+				continue;
 			}
+			selected[i] = 0;
+#ifdef __APPLE__
+			kp = sysmon_table_get_row(plist, i);
+			pid = (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PPID));
+#else
+			pid = plist[i].ki_ppid;
+#endif
 		}
 	}
 
@@ -824,15 +794,24 @@ main(int argc, char **argv)
 			selected[bestidx] = 1;
 	}
 
+	/*
+	 * With -T, add everything descended from the selected processes,
+	 * and act on each process before its parent.
+	 */
+	order = NULL;
+	if (subtree)
+		order = selecttree();
+
 	/*
 	 * Take the appropriate action for each matched process, if any.
 	 */
 	did_action = 0;
+	for (j = 0, rv = 0; j < nproc; j++) {
+		i = order != NULL ? order[j] : j;
 #ifdef __APPLE__
-	for (i = 0, rv = 0; i < nproc; i++) {
 		kp = sysmon_table_get_row(plist, i);
 #else
-	for (i = 0, rv = 0, kp = plist; i < nproc; i++, kp++) {
+		kp = &plist[i];
 #endif
 		if (PSKIP(kp))
 			continue;
@@ -857,6 +836,7 @@ main(int argc, char **argv)
 		fprintf(stderr,
 		    "No matching processes belonging to you were found\n");
 
+	free(order);
 	free(buf);
 	exit(rv ? STATUS_MATCH : STATUS_NOMATCH);
 }
@@ -868,18 +848,22 @@ usage(void)
 
 	if (pgrep)
 #ifdef __APPLE__
-		ustr = "[-Lfilnoqvx] [-d delim]";
+		ustr = "[-LTfilnoqvx] [-d delim]";
 #else
-		ustr = "[-LSfilnoqvx] [-d delim]";
+		ustr = "[-LSTfilnoqvx] [-d delim]";
 #endif
 	else
-		ustr = "[-signal] [-ILfilnovx]";
+		ustr = "[-signal] [-ILTfilnovx]";
 
 	fprintf(stderr,
 #ifdef __APPLE__
 		"usage: %s %s [-F pidfile] [-G gid]\n"
 		"             [-P ppid] [-U uid] [-g pgrp] [-t tty] [-u euid]\n"
 		"             pattern ...\n",
+#elif defined(__linux__)
+		"usage: %s %s [-F pidfile] [-G gid]\n"
+		"             [-P ppid] [-U uid] [-g pgrp] [-s sid] [-t tty]\n"
+		"             [-u euid] pattern ...\n",
 #else
 		"usage: %s %s [-F pidfile] [-G gid] [-M core] [-N system]\n"
 		"             [-P ppid] [-U uid] [-c class] [-g pgrp] [-j jail]\n"
@@ -925,7 +909,11 @@ show_process(const struct kinfo_proc *kp)
 		printf("%d", (int)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID)));
 #else
 	if ((longfmt || !pgrep) && matchargs &&
+#ifdef __linux__
+	    (argv = procfs_getargv(kp)) != NULL) {
+#else
 	    (argv = kvm_getargv(kd, kp, 0)) != NULL) {
+#endif
 		printf("%d ", (int)kp->ki_pid);
 		for (; *argv != NULL; argv++) {
 			printf("%s", *argv);
@@ -1004,6 +992,94 @@ grepact(const struct kinfo_proc *kp)
 	return (1);
 }
 
+/*
+ * Does the process meet the numeric criteria (-F, -U, -G, -u, -P, -g,
+ * -t, -s) and, on FreeBSD, -j and -c?  These are all cheap, so they are
+ * applied before the process name or arguments are looked at.
+ */
+static int
+#ifdef __APPLE__
+procfilter(const sysmon_row_t kp, pid_t pidfromfile)
+#else
+procfilter(const struct kinfo_proc *kp, pid_t pidfromfile)
+#endif
+{
+#if !defined(__APPLE__) && !defined(__linux__)
+	struct list *li;
+#endif
+
+#ifdef __APPLE__
+	if (pidfromfile >= 0 && (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID)) != pidfromfile)
+		return (0);
+	if (ruidset.ls_hash != NULL &&
+	    !in_set(&ruidset, (uid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_RUID))))
+		return (0);
+	if (rgidset.ls_hash != NULL &&
+	    !in_set(&rgidset, (gid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_RGID))))
+		return (0);
+	if (euidset.ls_hash != NULL &&
+	    !in_set(&euidset, (uid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_UID))))
+		return (0);
+	if (ppidset.ls_hash != NULL &&
+	    !in_set(&ppidset, (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PPID))))
+		return (0);
+	if (pgrpset.ls_hash != NULL &&
+	    !in_set(&pgrpset, (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PGID))))
+		return (0);
+	if (tdevset.ls_hash != NULL &&
+	    !((xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_FLAGS)) & PROC_FLAG_CONTROLT) == 0 &&
+	    in_set(&tdevset, (dev_t)-1)) &&
+	    !in_set(&tdevset, (dev_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_TDEV))))
+		return (0);
+#else
+	if (pidfromfile >= 0 && kp->ki_pid != pidfromfile)
+		return (0);
+	if (ruidset.ls_hash != NULL && !in_set(&ruidset, kp->ki_ruid))
+		return (0);
+	if (rgidset.ls_hash != NULL && !in_set(&rgidset, kp->ki_rgid))
+		return (0);
+	if (euidset.ls_hash != NULL && !in_set(&euidset, kp->ki_uid))
+		return (0);
+	if (ppidset.ls_hash != NULL && !in_set(&ppidset, kp->ki_ppid))
+		return (0);
+	if (pgrpset.ls_hash != NULL && !in_set(&pgrpset, kp->ki_pgid))
+		return (0);
+	/* A tty of -1 ("-t -") stands for no controlling terminal. */
+	if (tdevset.ls_hash != NULL &&
+	    !((kp->ki_flag & P_CONTROLT) == 0 && in_set(&tdevset, (dev_t)-1)) &&
+	    !in_set(&tdevset, kp->ki_tdev))
+		return (0);
+	if (sidset.ls_hash != NULL && !in_set(&sidset, kp->ki_sid))
+		return (0);
+#endif /* __APPLE__ */
+
+#if !defined(__APPLE__) && !defined(__linux__)
+	SLIST_FOREACH(li, &jidlist, li_chain) {
+		/* A particular jail ID, including 0 (not in jail) */
+		if (kp->ki_jid == (int)li->li_number)
+			break;
+		/* Any jail */
+		if (kp->ki_jid > 0 && li->li_number == -1)
+			break;
+	}
+	if (SLIST_FIRST(&jidlist) != NULL && li == NULL)
+		return (0);
+
+	SLIST_FOREACH(li, &classlist, li_chain) {
+		/*
+		 * We skip P_SYSTEM processes to match ps(1) output.
+		 */
+		if ((kp->ki_flag & P_SYSTEM) == 0 &&
+		    strcmp(kp->ki_loginclass, li->li_name) == 0)
+			break;
+	}
+	if (SLIST_FIRST(&classlist) != NULL && li == NULL)
+		return (0);
+#endif /* !__APPLE__ && !__linux__ */
+
+	return (1);
+}
+
 static void
 makelist(struct listhead *head, enum listtype type, char *src)
 {
@@ -1029,7 +1105,7 @@ makelist(struct listhead *head, enum listtype type, char *src)
 		SLIST_INSERT_HEAD(head, li, li_chain);
 		empty = 0;
 
-#ifdef __APPLE__
+#if defined(__APPLE__) || defined(__linux__)
 		li->li_number = (uid_t)strtol(sp, &ep, 0);
 		if (*ep == '\0') {
 #else
@@ -1048,6 +1124,8 @@ makelist(struct listhead *head, enum listtype type, char *src)
 				if (li->li_number == 0)
 					li->li_number = getsid(mypid);
 				break;
+#endif /* !__APPLE__ */
+#if !defined(__APPLE__) && !defined(__linux__)
 			case LT_JAIL:
 				if (li->li_number < 0)
 					errx(STATUS_BADUSAGE,
@@ -1056,7 +1134,7 @@ makelist(struct listhead *head, enum listtype type, char *src)
 				if (li->li_number == 0)
 					li->li_number = -1;	/* any jail */
 				break;
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 			case LT_TTY:
 				if (li->li_number < 0)
 					errx(STATUS_BADUSAGE,
@@ -1115,7 +1193,7 @@ foundtty:		if ((st.st_mode & S_IFCHR) == 0)
 
 			li->li_number = st.st_rdev;
 			break;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 		case LT_JAIL: {
 			int jid;
 
@@ -1136,7 +1214,7 @@ foundtty:		if ((st.st_mode & S_IFCHR) == 0)
 			if (li->li_name == NULL)
 				err(STATUS_ERROR, "Cannot allocate memory");
 			break;
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 		default:
 			usage();
 		}
@@ -1146,6 +1224,86 @@ foundtty:		if ((st.st_mode & S_IFCHR) == 0)
 		usage();
 }
 
+/*
+ * Every process is checked against every list, so once the lists are
+ * complete each one is turned into an open-addressing hash set.  The
+ * numbers are keyed as the type of the field they are compared with, so
+ * that, say, a uid of -1 and 4294967295 are the same key.
+ */
+#define	LIST_SLOT(ls, key) \
+	((size_t)(((key) * 0x9e3779b97f4a7c15ULL) >> (ls)->ls_shift))
+
+static uint64_t
+list_key(enum listtype type, long number)
+{
+
+	switch (type) {
+	case LT_USER:
+		return ((uid_t)number);
+	case LT_GROUP:
+		return ((gid_t)number);
+	case LT_TTY:
+		return ((dev_t)number);
+	default:
+		return ((pid_t)number);
+	}
+}
+
+static void
+hashlist(struct listset *ls, struct listhead *head, enum listtype type)
+{
+	struct list *li;
+	uint64_t key;
+	size_t count, nslots, mask, slot;
+	int bits;
+
+	count = 0;
+	SLIST_FOREACH(li, head, li_chain)
+		count++;
+	if (count == 0)
+		return;
+	/* At most half full. */
+	for (bits = 1; ((size_t)1 << bits) < count * 2; bits++)
+		;
+	nslots = (size_t)1 << bits;
+	mask = nslots - 1;
+	if ((ls->ls_hash = malloc(nslots * sizeof(*ls->ls_hash))) == NULL)
+		err(STATUS_ERROR, "Cannot allocate memory");
+	memset(ls->ls_hash, 0xff, nslots * sizeof(*ls->ls_hash));
+	ls->ls_shift = 64 - bits;
+	ls->ls_full = 0;
+
+	SLIST_FOREACH(li, head, li_chain) {
+		key = list_key(type, li->li_number);
+		if (key == HASH_EMPTY) {
+			ls->ls_full = 1;
+			continue;
+		}
+		for (slot = LIST_SLOT(ls, key); ls->ls_hash[slot] != HASH_EMPTY;
+		    slot = (slot + 1) & mask)
+			if (ls->ls_hash[slot] == key)
+				break;
+		ls->ls_hash[slot] = key;
+	}
+}
+
+static int
+in_set(const struct listset *ls, uint64_t key)
+{
+	size_t mask, slot;
+
+	if (ls->ls_hash == NULL)
+		return (0);
+	if (key == HASH_EMPTY)
+		return (ls->ls_full);
+	mask = ((size_t)1 << (64 - ls->ls_shift)) - 1;
+	for (slot = LIST_SLOT(ls, key); ls->ls_hash[slot] != HASH_EMPTY;
+	    slot = (slot + 1) & mask)
+		if (ls->ls_hash[slot] == key)
+			return (1);
+	return (0);
+}
+
 static int
 takepid(const char *pidfile, int pidfilelock)
 {
@@ -1190,3 +1348,337 @@ takepid(const char *pidfile, int pidfilelock)
 		errx(STATUS_ERROR, "Invalid pid in file `%s'", pidfile);
 	return (rval);
 }
+
+/*
+ * Can this pattern be looked for as a plain string?  Case-insensitive
+ * matching of anything but ASCII is left to regexec().
+ */
+static int
+patliteral(const char *p)
+{
+
+	for (; *p != '\0'; p++) {
+		if (strchr(".[]()*+?{}|^$\\", *p) != NULL)
+			return (0);
+		if ((cflags & REG_ICASE) && !isascii((unsigned char)*p))
+			return (0);
+	}
+	return (1);
+}
+
+/*
+ * Compile the patterns.  Each one is compiled on its own first, so that
+ * errors are reported against it.  Those that are not plain strings are
+ * then also joined into one extended regular expression, "(p1)|(p2)|...",
+ * so that a single regexec() decides a process however many patterns
+ * there are; which subexpression took part in the match tells which
+ * pattern it was.  Patterns with back-references cannot be joined, as
+ * that would renumber them; if there are any, or the joined expression
+ * does not compile, the patterns are tried one by one instead.
+ */
+static void
+patcompile(char **argv, int n)
+{
+	char errbuf[_POSIX2_LINE_MAX], *all, *p;
+	size_t group, len;
+	int i, join, nreg, rv;
+
+	if ((pats = calloc(n, sizeof(*pats))) == NULL)
+		err(STATUS_ERROR, "calloc");
+	npats = n;
+	join = (cflags & REG_EXTENDED) != 0;
+	len = 0;
+	nreg = 0;
+	for (i = 0; i < n; i++) {
+		if ((rv = regcomp(&pats[i].pat_reg, argv[i], cflags)) != 0) {
+			regerror(rv, &pats[i].pat_reg, errbuf, sizeof(errbuf));
+			errx(STATUS_BADUSAGE,
+			    "Cannot compile regular expression `%s' (%s)",
+			    argv[i], errbuf);
+		}
+		pats[i].pat_text = argv[i];
+		pats[i].pat_len = strlen(argv[i]);
+		pats[i].pat_literal = patliteral(argv[i]);
+		if (pats[i].pat_literal)
+			continue;
+		nreg++;
+		len += pats[i].pat_len + 3;		/* "(p)|" */
+		for (p = argv[i]; (p = strchr(p, '\\')) != NULL && p[1]; p += 2)
+			if (isdigit((unsigned char)p[1]))
+				join = 0;
+	}
+	if (nreg < 2 || !join)
+		return;
+
+	if ((all = malloc(len)) == NULL)
+		err(STATUS_ERROR, "malloc");
+	p = all;
+	group = 1;
+	for (i = 0; i < n; i++) {
+		if (pats[i].pat_literal)
+			continue;
+		p += sprintf(p, "%s(%s)", p == all ? "" : "|", argv[i]);
+		pats[i].pat_group = group;
+		group += 1 + pats[i].pat_reg.re_nsub;
+	}
+	if (regcomp(&patall, all, cflags) == 0) {
+		if ((patmatches = calloc(group, sizeof(*patmatches))) == NULL)
+			err(STATUS_ERROR, "calloc");
+		npatmatches = group;
+		havepatall = 1;
+	}
+	free(all);
+}
+
+static void
+patfree(void)
+{
+	int i;
+
+	for (i = 0; i < npats; i++)
+		regfree(&pats[i].pat_reg);
+	if (havepatall)
+		regfree(&patall);
+	free(patmatches);
+	free(pats);
+	patmatches = NULL;
+	pats = NULL;
+	npats = 0;
+	havepatall = 0;
+}
+
+static void
+regfail(int rv, const regex_t *reg)
+{
+	char errbuf[_POSIX2_LINE_MAX];
+
+	regerror(rv, reg, errbuf, sizeof(errbuf));
+	errx(STATUS_ERROR, "Regular expression evaluation error (%s)", errbuf);
+}
+
+/*
+ * Match mstr against all the patterns, the plain strings first.  Returns
+ * the index of a pattern that matched, or -1.
+ */
+static int
+patmatch(const char *mstr)
+{
+	const struct pattern *pat;
+	regmatch_t regmatch;
+	size_t len;
+	int i, rv;
+
+	len = strlen(mstr);
+	for (i = 0; i < npats; i++) {
+		pat = &pats[i];
+		if (!pat->pat_literal)
+			continue;
+		if (fullmatch) {
+			if (pat->pat_len == len && ((cflags & REG_ICASE) ?
+			    strcasecmp(mstr, pat->pat_text) :
+			    memcmp(mstr, pat->pat_text, len)) == 0)
+				return (i);
+		} else if ((cflags & REG_ICASE) ?
+		    strcasestr(mstr, pat->pat_text) != NULL :
+		    memmem(mstr, len, pat->pat_text, pat->pat_len) != NULL)
+			return (i);
+	}
+
+	if (havepatall) {
+		rv = regexec(&patall, mstr, npatmatches, patmatches, 0);
+		if (rv == REG_NOMATCH)
+			return (-1);
+		if (rv != 0)
+			regfail(rv, &patall);
+		if (fullmatch && (patmatches[0].rm_so != 0 ||
+		    patmatches[0].rm_eo != (regoff_t)len))
+			return (-1);
+		for (i = 0; i < npats; i++)
+			if (!pats[i].pat_literal &&
+			    patmatches[pats[i].pat_group].rm_so != -1)
+				return (i);
+		return (-1);
+	}
+
+	for (i = 0; i < npats; i++) {
+		pat = &pats[i];
+		if (pat->pat_literal)
+			continue;
+		rv = regexec(&pat->pat_reg, mstr, 1, &regmatch, 0);
+		if (rv == REG_NOMATCH)
+			continue;
+		if (rv != 0)
+			regfail(rv, &pat->pat_reg);
+		if (!fullmatch || (regmatch.rm_so == 0 &&
+		    regmatch.rm_eo == (regoff_t)len))
+			return (i);
+	}
+	return (-1);
+}
+
+#define	PID_SLOT(pid) \
+	((size_t)(((uint64_t)(uint32_t)(pid) * 0x9e3779b97f4a7c15ULL) >> pidshift))
+
+/*
+ * Index the process table by pid, leaving out the processes PSKIP()
+ * ignores, so that following a chain of parents costs one probe a step
+ * rather than a scan of the table.
+ */
+static void
+pidindex_build(void)
+{
+#ifdef __APPLE__
+	sysmon_row_t kp;
+#else
+	struct kinfo_proc *kp;
+#endif
+	size_t nslots, mask, slot;
+	pid_t pid;
+	int bits, i;
+
+	if (pidindex != NULL)
+		return;
+	/* At most half full. */
+	for (bits = 1; ((size_t)1 << bits) < (size_t)nproc * 2; bits++)
+		;
+	nslots = (size_t)1 << bits;
+	mask = nslots - 1;
+	if ((pidindex = malloc(nslots * sizeof(*pidindex))) == NULL)
+		err(STATUS_ERROR, "Cannot allocate memory");
+	for (slot = 0; slot < nslots; slot++)
+		pidindex[slot].ps_row = -1;
+	pidshift = 64 - bits;
+
+#ifdef __APPLE__
+	for (i = 0; i < nproc; i++) {
+		kp = sysmon_table_get_row(plist, i);
+#else
+	for (i = 0, kp = plist; i < nproc; i++, kp++) {
+#endif
+		if (PSKIP(kp))
+			continue;
+#ifdef __APPLE__
+		pid = (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PID));
+#else
+		pid = kp->ki_pid;
+#endif
+		for (slot = PID_SLOT(pid); pidindex[slot].ps_row != -1;
+		    slot = (slot + 1) & mask)
+			if (pidindex[slot].ps_pid == pid)
+				break;
+		pidindex[slot].ps_pid = pid;
+		pidindex[slot].ps_row = i;
+	}
+}
+
+/*
+ * The row of the process with the given pid, or -1.
+ */
+static int
+pidindex_find(pid_t pid)
+{
+	size_t mask, slot;
+
+	mask = ((size_t)1 << (64 - pidshift)) - 1;
+	for (slot = PID_SLOT(pid); pidindex[slot].ps_row != -1;
+	    slot = (slot + 1) & mask)
+		if (pidindex[slot].ps_pid == pid)
+			return (pidindex[slot].ps_row);
+	return (-1);
+}
+
+/*
+ * For -T: add to the selection every descendant of a selected process.
+ * A parent-to-children adjacency over the table is built in one pass,
+ * through the pid index, and walked depth first.  Returns the rows in
+ * post-order, children before their parents, for the action loop.
+ */
+static int *
+selecttree(void)
+{
+#ifdef __APPLE__
+	sysmon_row_t kp;
+#else
+	struct kinfo_proc *kp;
+#endif
+	int *parent, *first, *kids, *next, *stack, *order;
+	int i, j, n, r, sp;
+	pid_t ppid;
+
+	pidindex_build();
+	if ((parent = malloc(nproc * sizeof(*parent))) == NULL ||
+	    (first = calloc(nproc + 1, sizeof(*first))) == NULL ||
+	    (kids = malloc(nproc * sizeof(*kids))) == NULL ||
+	    (next = malloc(nproc * sizeof(*next))) == NULL ||
+	    (stack = malloc(nproc * sizeof(*stack))) == NULL ||
+	    (order = malloc(nproc * sizeof(*order))) == NULL)
+		err(STATUS_ERROR, "Cannot allocate memory");
+
+	/* Count each row's children, then lay them out by parent. */
+#ifdef __APPLE__
+	for (i = 0; i < nproc; i++) {
+		kp = sysmon_table_get_row(plist, i);
+		ppid = (pid_t)xpc_uint64_get_value(sysmon_row_get_value(kp, SYSMON_ATTR_PROC_PPID));
+#else
+	for (i = 0, kp = plist; i < nproc; i++, kp++) {
+		ppid = kp->ki_ppid;
+#endif
+		if ((r = pidindex_find(ppid)) == i)
+			r = -1;		/* its own parent, like pid 0 */
+		parent[i] = r;
+		if (r != -1)
+			first[r + 1]++;
+	}
+	for (i = 0; i < nproc; i++)
+		first[i + 1] += first[i];
+	for (i = 0; i < nproc; i++)
+		next[i] = first[i];
+	for (i = 0; i < nproc; i++)
+		if (parent[i] != -1)
+			kids[next[parent[i]]++] = i;
+
+	/* Walk each tree from its root, leaves first. */
+	for (i = 0; i < nproc; i++)
+		next[i] = -1;
+	n = 0;
+	for (i = 0; i < nproc; i++) {
+		if (parent[i] != -1)
+			continue;
+		sp = 0;
+		stack[sp++] = i;
+		next[i] = first[i];
+		while (sp > 0) {
+			r = stack[sp - 1];
+			if (next[r] < first[r + 1]) {
+				j = kids[next[r]++];
+				next[j] = first[j];
+				stack[sp++] = j;
+			} else {
+				order[n++] = r;
+				sp--;
+			}
+		}
+	}
+
+	/*
+	 * Parents come before their children in reverse post-order, so a
+	 * single sweep carries the selection all the way down.
+	 */
+	for (j = n - 1; j >= 0; j--) {
+		r = order[j];
+		if (parent[r] != -1 && selected[parent[r]])
+			selected[r] = 1;
+	}
+
+	/* A parent loop, which only a racing snapshot could show, has no root. */
+	for (i = 0; i < nproc; i++)
+		if (next[i] == -1)
+			order[n++] = i;
+
+	free(parent);
+	free(first);
+	free(kids);
+	free(next);
+	free(stack);
+	return (order);
+}
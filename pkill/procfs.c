@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Linux process source for pgrep and pkill.
+ *
+ * The processes are listed from the /proc directory, and each one's
+ * files are opened with openat(2) relative to that one directory and read
+ * into a single reused buffer.  stat alone supplies everything but the
+ * credentials; status is read only when a uid or gid is to be checked,
+ * and cmdline only when procfs_getargv() asks for it.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "linux.h"
+
+#define	PROC_ROOT	"/proc"
+#define	PROCBUF_MIN	4096
+
+/* Field numbers in /proc/<pid>/stat, as documented in proc(5). */
+#define	STAT_PPID	4
+#define	STAT_PGRP	5
+#define	STAT_SESSION	6
+#define	STAT_TTY_NR	7
+#define	STAT_FLAGS	9
+#define	STAT_STARTTIME	22
+
+#define	PF_KTHREAD	0x00200000	/* kernel thread (linux/sched.h) */
+
+static DIR	*procdir;
+static int	 procfd = -1;		/* dirfd(procdir) */
+static char	*procbuf;		/* reused read buffer */
+static size_t	 procbufsize;
+static char	**argvbuf;		/* procfs_getargv()'s vector */
+static size_t	 argvsize;
+static long	 clktck;
+static time_t	 boottime;		/* "btime" from /proc/stat */
+
+/*
+ * Read a file below /proc into procbuf and NUL-terminate it.  Returns the
+ * length read, or -1 if the file could not be read (typically because the
+ * process has exited since it was listed).
+ */
+static ssize_t
+procread(const char *path)
+{
+	ssize_t n, len;
+	size_t nsize;
+	char *nbuf;
+	int fd;
+
+	if ((fd = openat(procfd, path, O_RDONLY | O_CLOEXEC)) == -1)
+		return (-1);
+	len = 0;
+	for (;;) {
+		if ((size_t)len + 1 >= procbufsize) {
+			nsize = procbufsize != 0 ? procbufsize * 2 : PROCBUF_MIN;
+			if ((nbuf = realloc(procbuf, nsize)) == NULL) {
+				(void)close(fd);
+				return (-1);
+			}
+			procbuf = nbuf;
+			procbufsize = nsize;
+		}
+		n = read(fd, procbuf + len, procbufsize - len - 1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			(void)close(fd);
+			return (-1);
+		}
+		if (n == 0)
+			break;
+		len += n;
+	}
+	(void)close(fd);
+	procbuf[len] = '\0';
+	return (len);
+}
+
+static ssize_t
+procread_pid(pid_t pid, const char *file)
+{
+	char path[32];
+
+	(void)snprintf(path, sizeof(path), "%d/%s", (int)pid, file);
+	return (procread(path));
+}
+
+static int
+procfs_init(void)
+{
+	char *cp;
+
+	if ((procdir = opendir(PROC_ROOT)) == NULL)
+		return (-1);
+	procfd = dirfd(procdir);
+	clktck = sysconf(_SC_CLK_TCK);
+	if (procread("stat") != -1 &&
+	    (cp = strstr(procbuf, "\nbtime ")) != NULL)
+		boottime = (time_t)strtoll(cp + 7, NULL, 10);
+	return (0);
+}
+
+/*
+ * Parse /proc/<pid>/stat.  The command name is in parentheses and may
+ * itself contain spaces and parentheses, so the fixed fields are found
+ * from the last ')' rather than by splitting the whole line.
+ */
+static int
+parse_stat(struct kinfo_proc *kp, pid_t pid, char *buf)
+{
+	long long f[STAT_STARTTIME + 1];
+	char *lp, *rp, *cp;
+	size_t len;
+	int nf, tty;
+
+	if ((lp = strchr(buf, '(')) == NULL ||
+	    (rp = strrchr(buf, ')')) == NULL || rp < lp || rp[1] != ' ' ||
+	    rp[2] == '\0')
+		return (-1);
+	len = rp - lp - 1;
+	if (len > MAXCOMLEN)
+		len = MAXCOMLEN;
+	memcpy(kp->ki_comm, lp + 1, len);
+	kp->ki_comm[len] = '\0';
+
+	/* Skip the state letter. */
+	cp = rp + 3;
+	for (nf = STAT_PPID; nf <= STAT_STARTTIME && *cp != '\0'; nf++)
+		f[nf] = strtoll(cp, &cp, 10);
+	if (nf <= STAT_STARTTIME)
+		return (-1);
+
+	kp->ki_pid = pid;
+	kp->ki_ppid = (pid_t)f[STAT_PPID];
+	kp->ki_pgid = (pid_t)f[STAT_PGRP];
+	kp->ki_sid = (pid_t)f[STAT_SESSION];
+	tty = (int)f[STAT_TTY_NR];
+	if (tty == 0)
+		kp->ki_tdev = NODEV;
+	else {
+		/* The kernel's new_encode_dev() layout. */
+		kp->ki_tdev = makedev((tty >> 8) & 0xfff,
+		    (tty & 0xff) | ((tty >> 12) & 0xfff00));
+		kp->ki_flag |= P_CONTROLT;
+	}
+	if (f[STAT_FLAGS] & PF_KTHREAD)
+		kp->ki_flag |= P_KPROC;
+	kp->ki_start.tv_sec = boottime + f[STAT_STARTTIME] / clktck;
+	kp->ki_start.tv_usec = (f[STAT_STARTTIME] % clktck) * 1000000 / clktck;
+	return (0);
+}
+
+/*
+ * Pick the real and effective uid and the real gid out of
+ * /proc/<pid>/status.
+ */
+static int
+parse_status(struct kinfo_proc *kp, char *buf)
+{
+	unsigned int r, e;
+	char *cp;
+	int found;
+
+	found = 0;
+	for (cp = buf; cp != NULL && found != 2; cp = strchr(cp, '\n')) {
+		if (*cp == '\n')
+			cp++;
+		if (strncmp(cp, "Uid:", 4) == 0 &&
+		    sscanf(cp + 4, "%u %u", &r, &e) == 2) {
+			kp->ki_ruid = r;
+			kp->ki_uid = e;
+			found++;
+		} else if (strncmp(cp, "Gid:", 4) == 0 &&
+		    sscanf(cp + 4, "%u", &r) == 1) {
+			kp->ki_rgid = r;
+			found++;
+		}
+	}
+	return (found == 2 ? 0 : -1);
+}
+
+static int
+procfs_readproc(struct kinfo_proc *kp, pid_t pid, int flags)
+{
+
+	memset(kp, 0, sizeof(*kp));
+	if (procread_pid(pid, "stat") == -1 ||
+	    parse_stat(kp, pid, procbuf) == -1)
+		return (0);
+	if ((flags & PROCFS_CREDS) != 0 &&
+	    (procread_pid(pid, "status") == -1 ||
+	    parse_status(kp, procbuf) == -1))
+		return (0);
+	return (1);
+}
+
+/*
+ * Return the processes, or just the one with the given pid if pid is not
+ * -1.  Returns NULL, with errno set, if /proc cannot be read.
+ */
+struct kinfo_proc *
+procfs_getprocs(pid_t pid, int flags, int *nentries)
+{
+	struct kinfo_proc *kp, *nkp;
+	struct dirent *de;
+	char *ep;
+	int count, max, serrno;
+
+	if (procfd == -1 && procfs_init() == -1)
+		return (NULL);
+
+	count = 0;
+	max = 256;
+	if ((kp = malloc(max * sizeof(*kp))) == NULL)
+		return (NULL);
+
+	if (pid != -1) {
+		if (procfs_readproc(&kp[0], pid, flags))
+			count = 1;
+		*nentries = count;
+		return (kp);
+	}
+
+	rewinddir(procdir);
+	errno = 0;
+	while ((de = readdir(procdir)) != NULL) {
+		if (!isdigit((unsigned char)de->d_name[0]))
+			continue;
+		pid = (pid_t)strtol(de->d_name, &ep, 10);
+		if (*ep != '\0')
+			continue;
+		if (count == max) {
+			max *= 2;
+			if ((nkp = realloc(kp, max * sizeof(*kp))) == NULL) {
+				free(kp);
+				return (NULL);
+			}
+			kp = nkp;
+		}
+		if (procfs_readproc(&kp[count], pid, flags))
+			count++;
+		errno = 0;
+	}
+	if (errno != 0) {
+		serrno = errno;
+		free(kp);
+		errno = serrno;
+		return (NULL);
+	}
+	*nentries = count;
+	return (kp);
+}
+
+/*
+ * The argument vector of a process, like kvm_getargv(3).  The vector and
+ * the strings are overwritten by the next call.  Returns NULL if there are
+ * no arguments, as for kernel threads and zombies.
+ */
+char **
+procfs_getargv(const struct kinfo_proc *kp)
+{
+	ssize_t len;
+	size_t i, n;
+	char **nargv, *cp;
+
+	if ((len = procread_pid(kp->ki_pid, "cmdline")) <= 0)
+		return (NULL);
+	/* Ensure the last argument is terminated. */
+	if (procbuf[len - 1] != '\0')
+		len++;
+
+	n = 0;
+	for (cp = procbuf; cp < procbuf + len; cp += strlen(cp) + 1)
+		n++;
+	if (n + 1 > argvsize) {
+		if ((nargv = reallocarray(argvbuf, n + 1,
+		    sizeof(*argvbuf))) == NULL)
+			return (NULL);
+		argvbuf = nargv;
+		argvsize = n + 1;
+	}
+	for (i = 0, cp = procbuf; i < n; i++, cp += strlen(cp) + 1)
+		argvbuf[i] = cp;
+	argvbuf[n] = NULL;
+	return (argvbuf);
+}
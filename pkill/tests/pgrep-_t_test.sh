@@ -0,0 +1,41 @@
+#!/bin/sh
+
+base=`basename $0`
+
+echo "1..3"
+
+fails=0
+name="pgrep -T"
+sleep=$(pwd)/sleep.txt
+ln -sf /bin/sleep $sleep
+sh -c "$sleep 5 & $sleep 5; wait" &
+ppid=$!
+sleep 0.3
+chpids=`pgrep -f -P $ppid $sleep | sort`
+pidfile=$(pwd)/pidfile.txt
+echo $ppid > $pidfile
+if [ "`pgrep -T -F $pidfile | sort`" = "`printf '%s\n' $ppid $chpids | sort`" ]; then
+	echo "ok 1 - $name"
+else
+	echo "not ok 1 - $name"
+	fails=$((fails + 1))
+fi
+name="pgrep -T lists children first"
+if [ "`pgrep -T -P $$ -f "$sleep 5 &" | tail -n 1`" = "$ppid" ]; then
+	echo "ok 2 - $name"
+else
+	echo "not ok 2 - $name"
+	fails=$((fails + 1))
+fi
+name="pkill -T"
+pkill -T -P $$ -f "$sleep 5 &"
+sleep 0.3
+if [ -z "`pgrep -f $sleep`" ]; then
+	echo "ok 3 - $name"
+else
+	echo "not ok 3 - $name"
+	fails=$((fails + 1))
+	kill $ppid $chpids
+fi
+rm -f $sleep $pidfile
+exit $fails
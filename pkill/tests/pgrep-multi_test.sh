@@ -0,0 +1,48 @@
+#!/bin/sh
+
+base=`basename $0`
+
+echo "1..5"
+
+fails=0
+name="pgrep with several patterns"
+sleep=$(pwd)/sleep.txt
+ln -sf /bin/sleep $sleep
+$sleep 5 &
+sleep 0.3
+pid=$!
+if [ ! -z "`pgrep nomatch sleep.txt | egrep '^'"$pid"'$'`" ]; then
+	echo "ok 1 - $name"
+else
+	echo "not ok 1 - $name"
+	fails=$((fails + 1))
+fi
+if [ ! -z "`pgrep nomatch 'x+y' 'sl(e)+p\.t' | egrep '^'"$pid"'$'`" ]; then
+	echo "ok 2 - $name"
+else
+	echo "not ok 2 - $name"
+	fails=$((fails + 1))
+fi
+if [ "`pgrep sleep.txt 'sl(e)+p' '^sleep' | egrep -c '^'"$pid"'$'`" -eq 1 ]; then
+	echo "ok 3 - $name"
+else
+	echo "not ok 3 - $name"
+	fails=$((fails + 1))
+fi
+name="pgrep -x with several patterns"
+if [ -z "`pgrep -x slee 'sleep\.tx' nomatch | egrep '^'"$pid"'$'`" ]; then
+	echo "ok 4 - $name"
+else
+	echo "not ok 4 - $name"
+	fails=$((fails + 1))
+fi
+name="pgrep -i with several patterns"
+if [ ! -z "`pgrep -i -x nomatch SLEEP.TXT '(x|y)+' | egrep '^'"$pid"'$'`" ]; then
+	echo "ok 5 - $name"
+else
+	echo "not ok 5 - $name"
+	fails=$((fails + 1))
+fi
+kill $pid
+rm -f $sleep
+exit $fails
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Bump allocator for per-snapshot data.
+ *
+ * Everything ps allocates for one snapshot of the process table (thread
+ * info, argument areas, rendered command strings, saved u-area strings)
+ * has the same lifetime, so it is carved out of a chain of large chunks
+ * and given back all at once by resetting the arena.  Resetting keeps the
+ * chunks, so a watch-mode loop settles into reusing the same memory.
+ *
+ * An arena is used by one thread at a time.  The collection workers each
+ * get a sub-arena of the snapshot arena (arena_sub()); the sub-arenas are
+ * reset along with their parent.  Allocation failures are fatal, as
+ * elsewhere in ps.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps.h"
+
+#define	ARENA_CHUNK	(256 * 1024)	/* default chunk size */
+#define	ARENA_ALIGN	(sizeof(long double) > sizeof(void *) ? \
+			    sizeof(long double) : sizeof(void *))
+#define	ARENA_ROUND(n)	(((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t		size;		/* bytes in data[] */
+	size_t		used;
+	char		*data;
+};
+
+__thread ARENA	*curarena;		/* what amalloc() and friends use */
+
+static struct arena_chunk *
+arena_newchunk(size_t size)
+{
+	struct arena_chunk *c;
+
+	/* The chunk header lives at the front of its own allocation. */
+	if ((c = malloc(ARENA_ROUND(sizeof(*c)) + size)) == NULL)
+		errx(1, "malloc failed");
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	c->data = (char *)c + ARENA_ROUND(sizeof(*c));
+	return (c);
+}
+
+void *
+arena_alloc(ARENA *a, size_t size)
+{
+	struct arena_chunk *c, *nc;
+	size_t chunksize;
+
+	size = ARENA_ROUND(size > 0 ? size : 1);
+	STATS_ADD(ST_ALLOCS, 1);
+	STATS_ADD(ST_ALLOCBYTES, size);
+	c = a->cur;
+	if (c != NULL && c->size - c->used >= size) {
+		a->cur->used += size;
+		return (c->data + c->used - size);
+	}
+
+	/* Move on to the next chunk kept from before the last reset... */
+	if (c != NULL && c->next != NULL && c->next->size >= size) {
+		nc = c->next;
+		nc->used = 0;
+	} else {
+		/* ...or put a new one in after the current chunk. */
+		chunksize = a->chunksize != 0 ? a->chunksize : ARENA_CHUNK;
+		nc = arena_newchunk(size > chunksize ? size : chunksize);
+		if (c != NULL) {
+			nc->next = c->next;
+			c->next = nc;
+		} else {
+			nc->next = a->first;
+			a->first = nc;
+		}
+	}
+	a->cur = nc;
+	nc->used = size;
+	return (nc->data);
+}
+
+void *
+arena_calloc(ARENA *a, size_t nmemb, size_t size)
+{
+	void *p;
+
+	if (size != 0 && nmemb > SIZE_MAX / size)
+		errx(1, "malloc failed");
+	p = arena_alloc(a, nmemb * size);
+	memset(p, 0, nmemb * size);
+	return (p);
+}
+
+char *
+arena_strndup(ARENA *a, const char *s, size_t n)
+{
+	char *p;
+
+	n = strnlen(s, n);
+	p = arena_alloc(a, n + 1);
+	memcpy(p, s, n);
+	p[n] = '\0';
+	return (p);
+}
+
+char *
+arena_strdup(ARENA *a, const char *s)
+{
+	char *p;
+	size_t n;
+
+	n = strlen(s) + 1;
+	p = arena_alloc(a, n);
+	memcpy(p, s, n);
+	return (p);
+}
+
+char *
+arena_printf(ARENA *a, int *lenp, const char *fmt, ...)
+{
+	va_list ap;
+	char *p;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		errx(1, "vsnprintf failed");
+	p = arena_alloc(a, len + 1);
+	va_start(ap, fmt);
+	(void)vsnprintf(p, len + 1, fmt, ap);
+	va_end(ap);
+	if (lenp != NULL)
+		*lenp = len;
+	return (p);
+}
+
+/*
+ * Make sure a has at least n sub-arenas and return the i'th.
+ */
+ARENA *
+arena_sub(ARENA *a, int i, int n)
+{
+	ARENA *sub;
+
+	if (n > a->nsub) {
+		if ((sub = calloc(n, sizeof(*sub))) == NULL)
+			errx(1, "malloc failed");
+		if (a->nsub > 0)
+			memcpy(sub, a->sub, a->nsub * sizeof(*sub));
+		free(a->sub);
+		a->sub = sub;
+		a->nsub = n;
+	}
+	return (&a->sub[i]);
+}
+
+/*
+ * Forget everything allocated from a and its sub-arenas; the memory is
+ * kept for reuse.
+ */
+void
+arena_reset(ARENA *a)
+{
+	int i;
+
+	a->cur = a->first;
+	if (a->cur != NULL)
+		a->cur->used = 0;
+	for (i = 0; i < a->nsub; i++)
+		arena_reset(&a->sub[i]);
+}
+
+/* Shorthands for the calling thread's current arena. */
+
+void *
+amalloc(size_t size)
+{
+	return (arena_alloc(curarena, size));
+}
+
+void *
+acalloc(size_t nmemb, size_t size)
+{
+	return (arena_calloc(curarena, nmemb, size));
+}
+
+char *
+astrdup(const char *s)
+{
+	return (arena_strdup(curarena, s));
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Per-process data collection.
+ *
+ * Once the process table has been fetched and filtered, every kept
+ * process still needs its task/thread data and, for the command and args
+ * columns, its argument area.  Both are a handful of system calls per
+ * process and independent of one another, so they are spread across a
+ * small pool of threads.  Each worker claims a batch of KINFOs at a time
+ * and only ever writes to the KINFOs it claimed; everything that touches
+ * shared state (sizing, sorting, printing) stays on the main thread and
+ * runs after the pool has been joined.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ps.h"
+
+#define	COLLECT_BATCH	16		/* KINFOs claimed per trip */
+
+struct collect {
+	KINFO		*kinfo;
+	int		 nkinfo;
+	int		 flags;
+	atomic_int	 next;		/* first unclaimed KINFO */
+};
+
+struct collect_thread {
+	struct collect	*c;
+	ARENA		*arena;		/* this worker's allocations */
+};
+
+/*
+ * Fetch the raw argument area for a process, once.
+ */
+void
+get_procargs(KINFO *k)
+{
+	if (k->ki_procargsok != 0)
+		return;
+	if (KI_PROC(k)->p_stat == SZOMB) {
+		k->ki_procargsok = -1;
+		return;
+	}
+	k->ki_procargs = (*procsrc->procargs)(k, &k->ki_procargsize);
+	k->ki_procargsok = k->ki_procargs != NULL ? 1 : -1;
+}
+
+/*
+ * A per-process data source, fetched the first time a column asks for
+ * it.  Returns NULL if the process source cannot provide it.
+ */
+const void *
+get_pidsrc(KINFO *k, int src)
+{
+	static const size_t srcsize[SRC_MAX] = {
+		sizeof(struct proc_workqueueinfo),	/* SRC_WQ */
+		sizeof(uint32_t),			/* SRC_PERSONA */
+		sizeof(struct pidio),			/* SRC_IO */
+	};
+	void *buf;
+
+	if ((k->ki_srcdone & (1 << src)) == 0) {
+		k->ki_srcdone |= 1 << src;
+		buf = acalloc(1, srcsize[src]);
+		if ((*procsrc->pidinfo)(k, src, buf) == 0)
+			k->ki_src[src] = buf;
+	}
+	return (k->ki_src[src]);
+}
+
+static void
+collect_one(KINFO *k, int flags)
+{
+	flags &= ~k->ki_have;
+#if !PS_ENTITLEMENT_ENFORCED
+	if (flags & (COLLECT_TASK | COLLECT_THREADS))
+		(void)(*procsrc->taskinfo)(k,
+		    flags & (COLLECT_TASK | COLLECT_THREADS));
+#endif /* !PS_ENTITLEMENT_ENFORCED */
+	if (flags & COLLECT_ARGS)
+		get_procargs(k);
+	k->ki_have |= flags;
+}
+
+static void *
+collect_worker(void *arg)
+{
+	struct collect_thread *t = arg;
+	struct collect *c = t->c;
+	int i, end;
+
+	curarena = t->arena;
+
+	for (;;) {
+		i = atomic_fetch_add(&c->next, COLLECT_BATCH);
+		if (i >= c->nkinfo)
+			break;
+		end = i + COLLECT_BATCH;
+		if (end > c->nkinfo)
+			end = c->nkinfo;
+		for (; i < end; i++)
+			collect_one(&c->kinfo[i], c->flags);
+	}
+	return (NULL);
+}
+
+/*
+ * Collect the data named by flags for n KINFOs, using up to njobs
+ * threads (the calling thread included).  Returns once all of it is in.
+ * Workers allocate from sub-arenas of the caller's arena, so everything
+ * collected goes away when that arena is reset.
+ */
+void
+collect_procs(KINFO *kinfo, int n, int flags, int njobs)
+{
+	struct collect c;
+	struct collect_thread self, *threads;
+	pthread_t *tids;
+	int i, nthreads, error;
+
+	if (n <= 0 || flags == 0)
+		return;
+
+	/* Don't start threads that would have nothing to claim. */
+	if (njobs > (n + COLLECT_BATCH - 1) / COLLECT_BATCH)
+		njobs = (n + COLLECT_BATCH - 1) / COLLECT_BATCH;
+	if (njobs < 1)
+		njobs = 1;
+
+	c.kinfo = kinfo;
+	c.nkinfo = n;
+	c.flags = flags;
+	atomic_init(&c.next, 0);
+
+	tids = NULL;
+	threads = NULL;
+	nthreads = 0;
+	if (njobs > 1 && (tids = calloc(njobs - 1, sizeof(*tids))) != NULL &&
+	    (threads = calloc(njobs - 1, sizeof(*threads))) != NULL) {
+		/* Set up all the sub-arenas before any worker uses one. */
+		(void)arena_sub(curarena, 0, njobs - 1);
+		for (i = 0; i < njobs - 1; i++) {
+			threads[i].c = &c;
+			threads[i].arena = arena_sub(curarena, i, njobs - 1);
+			error = pthread_create(&tids[i], NULL, collect_worker,
+			    &threads[i]);
+			if (error != 0) {
+				/* Carry on with the threads we have. */
+				break;
+			}
+			nthreads++;
+		}
+	}
+
+	self.c = &c;
+	self.arena = curarena;
+	(void)collect_worker(&self);
+
+	for (i = 0; i < nthreads; i++)
+		(void)pthread_join(tids[i], NULL);
+	free(threads);
+	free(tids);
+}
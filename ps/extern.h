@@ -36,7 +36,7 @@ struct var;
 struct varent;
 
 extern fixpt_t ccpu;
-extern int cflag, eval, fscale, nlistread, rawcpu;
+extern int cflag, eval, fscale, nlistread, outstyle, psstats, rawcpu;
 #ifdef __APPLE__
 extern uint64_t mempages;
 #else
@@ -45,9 +45,36 @@ extern unsigned long mempages;
 extern time_t now;
 extern int showthreads, sumrusage, termwidth, totwidth;
 extern STAILQ_HEAD(velisthead, varent) varlist;
+extern const PROCSOURCE *procsrc;
+extern FILE *psout;
+extern struct field *fields;
+extern int nfields;
+extern __thread ARENA *curarena;
+#ifdef PS_FIXTURES
+extern const PROCSOURCE fixture_source;
+#endif
+extern const PROCSOURCE snap_source;
+#ifdef __APPLE__
+extern const PROCSOURCE sysctl_source;
+#elif defined(__linux__)
+extern const PROCSOURCE procfs_source;
+#endif
 
 __BEGIN_DECLS
-int	 get_task_info(KINFO *);
+void	*acalloc(size_t, size_t);
+void	*amalloc(size_t);
+void	*arena_alloc(ARENA *, size_t);
+void	*arena_calloc(ARENA *, size_t, size_t);
+char	*arena_printf(ARENA *, int *, const char *, ...) __printflike(3, 4);
+void	 arena_reset(ARENA *);
+char	*arena_strdup(ARENA *, const char *);
+char	*arena_strndup(ARENA *, const char *, size_t);
+ARENA	*arena_sub(ARENA *, int, int);
+char	*astrdup(const char *);
+int	 get_task_info(KINFO *, int);
+const	 void *get_pidsrc(KINFO *, int);
+void	 get_procargs(KINFO *);
+void	 collect_procs(KINFO *, int, int, int);
 void	 command(KINFO *, VARENT *);
 void	 just_command(KINFO *, VARENT *);
 void	 args(KINFO *, VARENT *);
@@ -63,13 +90,25 @@ int	 donlist(void);
 void	 evar(KINFO *, VARENT *);
 VARENT	*find_varentry(VAR *);
 const	 char *fmt_argv(char **, char *, size_t);
+void	 fmtcompile(void);
 int	 getpcpu(KINFO *);
 double	 getpmem(KINFO *);
 void	 logname(KINFO *, VARENT *);
+VAR	*lookupvar(const char *);
 void	 longtname(KINFO *, VARENT *);
 void	 lstarted(KINFO *, VARENT *);
 void	 maxrss(KINFO *, VARENT *);
+void	 namecache_prime(KINFO *, int);
+const	 char *nc_group(gid_t, int);
+int	 nc_gid_by_name(const char *, gid_t *);
+const	 char *nc_tty(dev_t);
+int	 nc_uid_by_name(const char *, uid_t *);
+const	 char *nc_user(uid_t, int);
 void	 nlisterr(struct nlist *);
+void	 outfmt_header(FILE *);
+void	 outfmt_init(void);
+int	 outfmt_parse(const char *);
+void	 outfmt_row(KINFO *, FILE *);
 void	 p_rssize(KINFO *, VARENT *);
 void	 pagein(KINFO *, VARENT *);
 void	 parsefmt(const char *, int);
@@ -81,21 +120,40 @@ void	 pmem(KINFO *, VARENT *);
 void	 pri(KINFO *, VARENT *);
 void	 rtprior(KINFO *, VARENT *);
 void	 printheader(void);
+void	 printrow(KINFO *);
 void	 pvar(KINFO *, VARENT *);
 void	 runame(KINFO *, VARENT *);
 void	 rvar(KINFO *, VARENT *);
 int	 s_runame(KINFO *);
 int	 s_uname(KINFO *);
 void	 showkey(void);
+void	 snap_open(const char *);
+void	 snap_save(const char *, KINFO *, int);
+void	 sort_forest(KINFO **, int);
+int	 sort_needs(void);
+void	 sort_parse(const char *);
+KINFO	**sort_procs(KINFO *, int);
+KINFO	**sort_top(KINFO *, int, int);
 void	 started(KINFO *, VARENT *);
 void	 state(KINFO *, VARENT *);
+void	 stats_add(int, unsigned long);
+void	 stats_init(int);
+void	 stats_phase(int);
 void	 tdev(KINFO *, VARENT *);
 void	 tname(KINFO *, VARENT *);
 void	 tsize(KINFO *, VARENT *);
 void	 ucomm(KINFO *, VARENT *);
 void	 uname(KINFO *, VARENT *);
 void	 uvar(KINFO *, VARENT *);
+int	 varcollect(const VAR *);
 void	 vsize(KINFO *, VARENT *);
 void	 wchan(KINFO *, VARENT *);
+void	 watch_carry(KINFO *, int);
+void	 watch_cpu(KINFO *, int);
+void	 watch_save(KINFO *, int);
+FILE	*watch_begin(void);
+void	 watch_end(void);
+void	 watch_wait(double);
 void	 wq(KINFO *, VARENT *);
+void	 wql(KINFO *, VARENT *);
 __END_DECLS
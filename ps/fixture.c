@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Synthetic process source, for benchmarks and tests.
+ *
+ * If PS_FIXTURE is set, ps reads a generated process table instead of the
+ * live one.  The value is a comma-separated list of settings:
+ *
+ *	procs=N		number of processes (1000)
+ *	args=N		bytes of arguments per process (64)
+ *	threads=N	threads per process (1)
+ *	users=N		distinct uids, from 0 (8)
+ *	seed=N		generator seed (1)
+ *
+ * The same settings always produce the same table, apart from anything
+ * ps derives from the current time.  No system calls are made, so what a
+ * benchmark measures is ps itself.
+ *
+ * None of this is in the installed ps, which must always show the live
+ * system.  Benchmark builds compile this file in and define PS_FIXTURES,
+ * which also enables the PS_BENCH report in stats.c.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps.h"
+
+#define	FX_BASETIME	1700000000	/* start time of the first process */
+
+extern int mach_state_order();
+
+static struct {
+	long	procs;
+	long	args;
+	long	threads;
+	long	users;
+	long	seed;
+} fx = { 1000, 64, 1, 8, 1 };
+
+static const char *fxcomm[] = {
+	"launchd", "syslogd", "kernel_task", "sshd", "zsh", "bash", "make",
+	"cc", "ld", "python3", "Finder", "mds_stores", "WindowServer",
+	"coreaudiod", "cfprefsd", "distnoted",
+};
+#define	FX_NCOMM	(sizeof(fxcomm) / sizeof(fxcomm[0]))
+
+static uint64_t
+fx_rand(uint64_t *s)
+{
+	uint64_t z;
+
+	/* splitmix64 */
+	z = (*s += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (z ^ (z >> 31));
+}
+
+/* Generator state for one process, so that every callback agrees. */
+static uint64_t
+fx_state(pid_t pid)
+{
+	return ((uint64_t)fx.seed << 32 ^ (uint64_t)pid);
+}
+
+static void
+fx_parse(const char *spec)
+{
+	static const struct {
+		const char *name;
+		long	*val;
+		long	min;
+	} keys[] = {
+		{ "procs", &fx.procs, 1 },
+		{ "args", &fx.args, 0 },
+		{ "threads", &fx.threads, 0 },
+		{ "users", &fx.users, 1 },
+		{ "seed", &fx.seed, 0 },
+	};
+	char *buf, *p, *val, *ep;
+	size_t i;
+
+	if ((buf = strdup(spec)) == NULL)
+		errx(1, "malloc failed");
+	while ((p = strsep(&buf, ",")) != NULL) {
+		if (*p == '\0')
+			continue;
+		if ((val = strchr(p, '=')) == NULL)
+			errx(1, "PS_FIXTURE: %s: expected name=value", p);
+		*val++ = '\0';
+		for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+			if (strcmp(p, keys[i].name) == 0)
+				break;
+		if (i == sizeof(keys) / sizeof(keys[0]))
+			errx(1, "PS_FIXTURE: unknown setting %s", p);
+		*keys[i].val = strtol(val, &ep, 10);
+		if (*val == '\0' || *ep != '\0' || *keys[i].val < keys[i].min ||
+		    *keys[i].val > 10000000)
+			errx(1, "PS_FIXTURE: %s: bad value %s", p, val);
+	}
+	free(buf);
+}
+
+static int
+fx_match(const struct kinfo_proc *kp, int what, int flag)
+{
+
+	switch (what) {
+	case KERN_PROC_PID:
+		return (kp->kp_proc.p_pid == (pid_t)flag);
+	case KERN_PROC_PGRP:
+		return (kp->kp_eproc.e_pgid == (pid_t)flag);
+	case KERN_PROC_TTY:
+		return (kp->kp_eproc.e_tdev == (dev_t)flag);
+	case KERN_PROC_UID:
+		return (kp->kp_eproc.e_ucred.cr_uid == (uid_t)flag);
+	case KERN_PROC_RUID:
+		return (kp->kp_eproc.e_pcred.p_ruid == (uid_t)flag);
+	default:
+		return (1);
+	}
+}
+
+static void
+fx_proc(struct kinfo_proc *kp, pid_t pid)
+{
+	struct extern_proc *p;
+	struct eproc *e;
+	uint64_t s, r;
+
+	s = fx_state(pid);
+	r = fx_rand(&s);
+	memset(kp, 0, sizeof(*kp));
+	p = &kp->kp_proc;
+	e = &kp->kp_eproc;
+
+	p->p_pid = pid;
+	p->p_stat = r % 16 == 0 ? SRUN : r % 97 == 1 ? SZOMB : SSLEEP;
+	p->p_starttime.tv_sec = FX_BASETIME + pid;
+	p->p_nice = r % 13 == 0 ? 5 : 0;
+	(void)snprintf(p->p_comm, sizeof(p->p_comm), "%s",
+	    fxcomm[(r >> 8) % FX_NCOMM]);
+
+	/* Parents come earlier, so the table is a tree rooted at pid 1. */
+	e->e_ppid = pid == 1 ? 0 : 1 + (pid_t)((r >> 16) % (pid - 1));
+	e->e_pgid = (r >> 24) % 4 == 0 ? e->e_ppid : pid;
+	e->e_ucred.cr_uid = e->e_pcred.p_ruid = e->e_pcred.p_svuid =
+	    (uid_t)((r >> 32) % fx.users);
+	e->e_ucred.cr_gid = e->e_pcred.p_rgid = e->e_pcred.p_svgid =
+	    e->e_ucred.cr_uid;
+	e->e_tdev = NODEV;
+	if ((r >> 40) % 8 == 0) {
+		p->p_flag |= P_CONTROLT;
+		e->e_tdev = makedev(16, (int)((r >> 48) % 32));
+		e->e_tpgid = e->e_pgid;
+	}
+	if (e->e_pgid == pid)
+		e->e_flag |= EPROC_SLEADER;
+}
+
+static struct kinfo_proc *
+fixture_getprocs(int what, int flag, int *nentries)
+{
+	struct kinfo_proc *kp;
+	const char *spec;
+	static int parsed;
+	int count;
+	pid_t pid;
+
+	if (!parsed) {
+		if ((spec = getenv("PS_FIXTURE")) != NULL)
+			fx_parse(spec);
+		parsed = 1;
+	}
+	if ((kp = malloc(fx.procs * sizeof(*kp))) == NULL)
+		errx(1, "malloc failed");
+	count = 0;
+	for (pid = 1; pid <= fx.procs; pid++) {
+		fx_proc(&kp[count], pid);
+		if (fx_match(&kp[count], what, flag))
+			count++;
+	}
+	*nentries = count;
+	return (kp);
+}
+
+static void
+fx_time(uint64_t r, time_value_t *tv)
+{
+	tv->seconds = (integer_t)(r % 3600);
+	tv->microseconds = (integer_t)((r >> 12) % 1000000);
+}
+
+static int
+fixture_taskinfo(KINFO *ki, int what)
+{
+	thread_values_t *tv;
+	uint64_t s, r, utime, stime;
+	int j, st;
+
+	s = fx_state(KI_PROC(ki)->p_pid);
+	(void)fx_rand(&s);	/* the one fx_proc() used */
+	r = fx_rand(&s);
+	utime = fx_rand(&s);
+	stime = fx_rand(&s);
+
+	if (what & COLLECT_TASK) {
+		ki->tasks_info.virtual_size = (r % 4096 + 1) << 20;
+		ki->tasks_info.resident_size = ((r >> 12) % 256 + 1) << 20;
+		fx_time(utime, &ki->tasks_info.user_time);
+		fx_time(stime, &ki->tasks_info.system_time);
+		memset(&ki->times, 0, sizeof(ki->times));
+		ki->tasks_info.policy = POLICY_TIMESHARE;
+		ki->schedinfo.tshare.base_priority = 31;
+		ki->schedinfo.tshare.cur_priority = 31;
+		ki->curpri = ki->basepri = 31;
+		ki->cpu_usage = (int)((r >> 20) % 16 == 0 ?
+		    (r >> 24) % TH_USAGE_SCALE : 0);
+		ki->swapped = 0;
+		ki->invalid_tinfo = 0;
+	}
+	if ((what & COLLECT_THREADS) == 0)
+		return (0);
+
+	ki->thread_count = (unsigned int)fx.threads;
+	ki->thval = acalloc(fx.threads, sizeof(*ki->thval));
+	ki->state = mach_state_order(KI_PROC(ki)->p_stat == SRUN ?
+	    TH_STATE_RUNNING : TH_STATE_WAITING, 0);
+	for (j = 0; j < fx.threads; j++) {
+		tv = &ki->thval[j];
+		r = fx_rand(&s);
+		fx_time(r, &tv->tb.user_time);
+		fx_time(r >> 20, &tv->tb.system_time);
+		tv->tb.policy = POLICY_TIMESHARE;
+		tv->tb.run_state = KI_PROC(ki)->p_stat == SRUN && j == 0 ?
+		    TH_STATE_RUNNING : TH_STATE_WAITING;
+		tv->tb.sleep_time = (integer_t)((r >> 40) % 60);
+		tv->schedinfo.tshare.base_priority = 31;
+		tv->schedinfo.tshare.cur_priority = 31;
+		st = mach_state_order(tv->tb.run_state, tv->tb.sleep_time);
+		if (j == 0 || st < ki->state)
+			ki->state = st;
+	}
+	ki->invalid_thinfo = 0;
+	return (0);
+}
+
+/*
+ * A KERN_PROCARGS2 area: argc, the exec path and its padding, then the
+ * argument strings (about fx.args bytes of them) and a short environment.
+ */
+static char *
+fixture_procargs(KINFO *ki, size_t *sizep)
+{
+	static const char env[] = "PATH=/usr/bin:/bin\0HOME=/var/empty\0";
+	char path[64], *buf, *cp, *end;
+	size_t len, size;
+	int argc;
+
+	(void)snprintf(path, sizeof(path), "/usr/libexec/%s",
+	    KI_PROC(ki)->p_comm);
+	len = strlen(path) + 1;
+	size = sizeof(argc) + len + 8 + len + fx.args + 24 + sizeof(env);
+	buf = amalloc(size);
+	memset(buf, 0, size);
+
+	cp = buf + sizeof(argc);
+	memcpy(cp, path, len);
+	cp += len + 8;
+	memcpy(cp, path, len);		/* argv[0] */
+	cp += len;
+	argc = 1;
+	for (end = cp + fx.args; cp < end; argc++)
+		cp += snprintf(cp, 24, "--opt%d", argc) + 1;
+	memcpy(cp, env, sizeof(env));
+	cp += sizeof(env);
+	memcpy(buf, &argc, sizeof(argc));
+	*sizep = cp - buf;
+	return (buf);
+}
+
+/*
+ * Workqueue and I/O figures; processes have no persona.  Each source
+ * draws from its own stream so that none of them disturbs the others.
+ */
+static int
+fixture_pidinfo(KINFO *ki, int src, void *buf)
+{
+	struct proc_workqueueinfo *wq;
+	struct pidio *pio;
+	uint64_t s, r;
+
+	s = fx_state(KI_PROC(ki)->p_pid) ^ (uint64_t)(src + 1) << 56;
+	r = fx_rand(&s);
+	switch (src) {
+	case SRC_WQ:
+		wq = buf;
+		wq->pwq_nthreads = (uint32_t)(r % 8);
+		wq->pwq_runthreads = (uint32_t)((r >> 8) % (wq->pwq_nthreads + 1));
+		wq->pwq_blockedthreads = wq->pwq_nthreads - wq->pwq_runthreads;
+		wq->pwq_state = (r >> 16) % 64 == 0 ?
+		    WQ_EXCEEDED_CONSTRAINED_THREAD_LIMIT : 0;
+		return (0);
+	case SRC_IO:
+		pio = buf;
+		pio->pio_rbytes = (r % 4096) << 12;
+		pio->pio_wbytes = ((r >> 12) % 1024) << 12;
+		return (0);
+	default:
+		return (-1);
+	}
+}
+
+const PROCSOURCE fixture_source = {
+	"fixture",
+	fixture_getprocs,
+	fixture_taskinfo,
+	fixture_procargs,
+	fixture_pidinfo,
+};
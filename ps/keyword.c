@@ -39,9 +39,11 @@ static const char rcsid[] =
 #include <sys/param.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#ifndef __linux__
 #include <sys/proc.h>
 #include <sys/sysctl.h>
 #include <sys/user.h>
+#endif /* !__linux__ */
 
 #include <err.h>
 #include <stddef.h>
@@ -54,17 +56,16 @@ static const char rcsid[] =
 VAR *findvar(char *, int, char **header);
 static int  vcmp(const void *, const void *);
 
-#ifdef __APPLE__
 #ifndef nitems
 #define	nitems(x)	(sizeof((x)) / sizeof((x)[0]))
 #endif
-#endif
 
 /* Compute offset in common structures. */
 #define	POFF(x)	offsetof(struct extern_proc, x)
 #define	EOFF(x)	offsetof(struct eproc, x)
 #define	UOFF(x)	offsetof(struct usave, x)
 #define	ROFF(x)	offsetof(struct rusage, x)
+#define	WQOFF(x) offsetof(struct proc_workqueueinfo, x)
 
 #define	EMULLEN	13		/* enough for "FreeBSD ELF32" */
 #define	LWPFMT	"d"
@@ -84,11 +85,11 @@ static int  vcmp(const void *, const void *);
 /* PLEASE KEEP THE TABLE BELOW SORTED ALPHABETICALLY!!! */
 static VAR var[] = {
 	/* 4133537: 5 characters to accomodate 100% or more */
-	{"%cpu", "%CPU", NULL, 0, pcpu, NULL, 5, 0, CHAR, NULL, 0},
+	{"%cpu", "%CPU", NULL, TASKINFO|THRINFO, pcpu, NULL, 5, 0, CHAR, NULL, 0},
 #ifdef __APPLE__
-	{"%mem", "%MEM", NULL, ENTITLED, pmem, NULL, 4},
+	{"%mem", "%MEM", NULL, TASKINFO|ENTITLED, pmem, NULL, 4},
 #else
-	{"%mem", "%MEM", NULL, 0, pmem, NULL, 4},
+	{"%mem", "%MEM", NULL, TASKINFO, pmem, NULL, 4},
 #endif
 	{"acflag", "ACFLG",
 		NULL, 0, pvar, NULL, 3, POFF(p_acflag), USHORT, "x"},
@@ -158,7 +159,7 @@ static VAR var[] = {
 	{"pmem", "", "%mem"},
 	{"ppid", "PPID",
 		NULL, 0, evar, NULL, PIDLEN, EOFF(e_ppid), UINT, PIDFMT},
-	{"pri", "PRI", NULL, 0, pri, NULL, 3},
+	{"pri", "PRI", NULL, TASKINFO|THRINFO, pri, NULL, 3},
 #ifdef __APPLE__
 	{"prsna", "PRSNA", NULL, 0, persona, NULL, UIDLEN, 0, UINT, UIDFMT},
 #endif /* __APPLE__ */
@@ -169,9 +170,9 @@ static VAR var[] = {
 		UINT, UIDFMT},
 	{"rgroup", "RGROUP", "rgid"},
 #ifdef __APPLE__
-	{"rss", "RSS", NULL, ENTITLED, p_rssize, NULL, 6},
+	{"rss", "RSS", NULL, TASKINFO|ENTITLED, p_rssize, NULL, 6},
 #else
-	{"rss", "RSS", NULL, 0, p_rssize, NULL, 6},
+	{"rss", "RSS", NULL, TASKINFO, p_rssize, NULL, 6},
 #endif
 #if FIXME
 	{"rtprio", "RTPRIO", NULL, 0, rtprior, NULL, 7, POFF(p_rtprio)},
@@ -192,11 +193,11 @@ static VAR var[] = {
 	{"sl", "SL", NULL, 0, pvar, NULL, 3, POFF(p_slptime), UINT, "d"},
 	{"start", "STARTED", NULL, LJUST|USER, started, NULL, 7},
 	{"stat", "", "state"},
-	{"state", "STAT", NULL, 0, state, NULL, 4},
+	{"state", "STAT", NULL, TASKINFO|THRINFO, state, NULL, 4},
 #ifdef __APPLE__
-	{"stime", "STIME", NULL, USER|ENTITLED, pstime, NULL, 9},
+	{"stime", "STIME", NULL, USER|TASKINFO|ENTITLED, pstime, NULL, 9},
 #else
-	{"stime", "STIME", NULL, USER, pstime, NULL, 9},
+	{"stime", "STIME", NULL, USER|TASKINFO, pstime, NULL, 9},
 #endif
 	{"svgid", "SVGID", NULL, 0,
 		evar, NULL, UIDLEN, EOFF(e_pcred.p_svgid), UINT, UIDFMT},
@@ -204,9 +205,9 @@ static VAR var[] = {
 		evar, NULL, UIDLEN, EOFF(e_pcred.p_svuid), UINT, UIDFMT},
 	{"tdev", "TDEV", NULL, 0, tdev, NULL, 4},
 #ifdef __APPLE__
-	{"time", "TIME", NULL, USER|ENTITLED, cputime, NULL, 9},
+	{"time", "TIME", NULL, USER|TASKINFO|ENTITLED, cputime, NULL, 9},
 #else
-	{"time", "TIME", NULL, USER, cputime, NULL, 9},
+	{"time", "TIME", NULL, USER|TASKINFO, cputime, NULL, 9},
 #endif
 	{"tpgid", "TPGID",
 		NULL, 0, evar, NULL, 4, EOFF(e_tpgid), UINT, PIDFMT},
@@ -221,21 +222,21 @@ static VAR var[] = {
 	{"user", "USER", NULL, LJUST|DSIZ, uname, s_uname, USERLEN},
 	{"usrpri", "", "upr"},
 #ifdef __APPLE__
-	{"utime", "UTIME", NULL, USER|ENTITLED, putime, NULL, 9},
+	{"utime", "UTIME", NULL, USER|TASKINFO|ENTITLED, putime, NULL, 9},
 #else
-	{"utime", "UTIME", NULL, USER, putime, NULL, 9},
+	{"utime", "UTIME", NULL, USER|TASKINFO, putime, NULL, 9},
 #endif
 	{"vsize", "", "vsz"},
 #ifdef __APPLE__
-	{"vsz", "VSZ", NULL, ENTITLED, vsize, NULL, 8},
+	{"vsz", "VSZ", NULL, TASKINFO|ENTITLED, vsize, NULL, 8},
 #else
-	{"vsz", "VSZ", NULL, 0, vsize, NULL, 8},
+	{"vsz", "VSZ", NULL, TASKINFO, vsize, NULL, 8},
 #endif
 	{"wchan", "WCHAN", NULL, LJUST, wchan, NULL, 6},
-	{"wq", "WQ", NULL, 0, wq, NULL, 4, 0, CHAR, NULL, 0},
-	{"wqb", "WQB", NULL, 0, wq, NULL, 4, 0, CHAR, NULL, 0},
-	{"wql", "WQL", NULL, 0, wq, NULL, 3, 0, CHAR, NULL, 0},
-	{"wqr", "WQR", NULL, 0, wq, NULL, 4, 0, CHAR, NULL, 0},
+	{"wq", "WQ", NULL, 0, wq, NULL, 4, WQOFF(pwq_nthreads), CHAR, NULL, 0},
+	{"wqb", "WQB", NULL, 0, wq, NULL, 4, WQOFF(pwq_blockedthreads), CHAR, NULL, 0},
+	{"wql", "WQL", NULL, 0, wql, NULL, 3, 0, CHAR, NULL, 0},
+	{"wqr", "WQR", NULL, 0, wq, NULL, 4, WQOFF(pwq_runthreads), CHAR, NULL, 0},
 	{"xstat", "XSTAT", NULL, 0, pvar, NULL, 4, POFF(p_xstat), USHORT, "x"},
 	{""},
 };
@@ -279,6 +280,9 @@ showkey(void)
 	(void) printf("\n");
 }
 
+/* The format lives as long as ps does. */
+static ARENA fmtarena = { .chunksize = 4096 };
+
 void
 parsefmt(const char *p, int user)
 {
@@ -320,17 +324,11 @@ parsefmt(const char *p, int user)
 			if (vent != NULL)
 				continue;
 		}
-		if ((vent = malloc(sizeof(struct varent))) == NULL)
-			errx(1, "malloc failed");
+		vent = arena_alloc(&fmtarena, sizeof(struct varent));
 		vent->header = v->header;
-		if (hp) {
-			hp = strdup(hp);
-			if (hp)
-				vent->header = hp;
-		}
-		vent->var = malloc(sizeof(*vent->var));
-		if (vent->var == NULL)
-			errx(1, "malloc failed");
+		if (hp)
+			vent->header = arena_strdup(&fmtarena, hp);
+		vent->var = arena_alloc(&fmtarena, sizeof(*vent->var));
 		memcpy(vent->var, v, sizeof(*vent->var));
 		STAILQ_INSERT_TAIL(&varlist, vent, next_ve);
 	}
@@ -345,7 +343,6 @@ parsefmt(const char *p, int user)
 VAR *
 findvar(char *p, int user, char **header)
 {
-	size_t rflen;
 	VAR *v, key;
 	char *hp, *realfmt;
 
@@ -376,9 +373,8 @@ findvar(char *p, int user, char **header)
 			 * keywords.  Presently there are no aliases
 			 * which do that.
 			 */
-			rflen = strlen(v->alias) + strlen(hp) + 2;
-			realfmt = malloc(rflen);
-			snprintf(realfmt, rflen, "%s=%s", v->alias, hp);
+			realfmt = arena_printf(&fmtarena, NULL, "%s=%s",
+			    v->alias, hp);
 			parsefmt(realfmt, user);
 		}
 		return ((VAR *)NULL);
@@ -402,6 +398,46 @@ findvar(char *p, int user, char **header)
 	return (v);
 }
 
+/*
+ * Look a keyword up by name, following an alias, without adding it to
+ * the format.  Returns NULL if there is no such keyword.
+ */
+VAR *
+lookupvar(const char *name)
+{
+	VAR *v, key;
+
+	key.name = name;
+	v = bsearch(&key, var, nitems(var) - 1, sizeof(var[0]), vcmp);
+	if (v != NULL && v->alias != NULL) {
+		key.name = v->alias;
+		v = bsearch(&key, var, nitems(var) - 1, sizeof(var[0]), vcmp);
+	}
+#if PS_ENTITLEMENT_ENFORCED
+	if (v != NULL && (v->flag & ENTITLED) != 0)
+		errx(1, "%s: requires entitlement", name);
+#endif
+	return (v);
+}
+
+/*
+ * What collect_procs() has to gather for a keyword, as COLLECT_* flags.
+ */
+int
+varcollect(const VAR *v)
+{
+	int need;
+
+	need = 0;
+	if (v->flag & TASKINFO)
+		need |= COLLECT_TASK;
+	if (v->flag & THRINFO)
+		need |= COLLECT_THREADS;
+	if (v->flag & COMM)
+		need |= COLLECT_ARGS;
+	return (need);
+}
+
 static int
 vcmp(const void *a, const void *b)
 {
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Darwin-shaped process structures for the Linux /proc source (procfs.c).
+ *
+ * The output routines in print.c and the offsets in keyword.c are written
+ * against struct kinfo_proc and the Mach task/thread info structures.  On
+ * Linux neither exists, so provide just enough of both for procfs.c to
+ * fill in; fields with no Linux equivalent are simply left zero.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/sysmacros.h>
+
+#include <limits.h>
+#include <stdint.h>
+
+#ifndef MAXCOMLEN
+#define	MAXCOMLEN	16
+#endif
+#ifndef MAXLOGNAME
+#define	MAXLOGNAME	33
+#endif
+#define	WMESGLEN	7
+
+#ifndef NODEV
+#define	NODEV		((dev_t)-1)
+#endif
+
+#ifndef issetugid
+#define	issetugid()	(getuid() != geteuid() || getgid() != getegid())
+#endif
+
+#ifndef UID_MAX
+#define	UID_MAX		UINT_MAX
+#endif
+#ifndef GID_MAX
+#define	GID_MAX		UINT_MAX
+#endif
+
+#ifndef __printflike
+#define	__printflike(fmtarg, firstvararg) \
+	__attribute__((__format__ (__printf__, fmtarg, firstvararg)))
+#endif
+
+/* p_stat */
+#define	SIDL		1
+#define	SRUN		2
+#define	SSLEEP		3
+#define	SSTOP		4
+#define	SZOMB		5
+
+/* p_flag */
+#define	P_CONTROLT	0x00000002
+#define	P_PPWAIT	0x00000010
+#define	P_SYSTEM	0x00000200
+#define	P_TRACED	0x00000800
+#define	P_WEXIT		0x00002000
+#define	P_NOSWAP	0
+#define	P_PHYSIO	0
+
+/* e_flag */
+#define	EPROC_CTTY	0x01
+#define	EPROC_SLEADER	0x02
+
+/* sysctl(3) process selectors, as understood by procfs_getprocs(). */
+#define	KERN_PROC_ALL		0
+#define	KERN_PROC_PID		1
+#define	KERN_PROC_PGRP		2
+#define	KERN_PROC_SESSION	3
+#define	KERN_PROC_TTY		4
+#define	KERN_PROC_UID		5
+#define	KERN_PROC_RUID		6
+
+typedef uint32_t	fixpt_t;
+
+struct extern_proc {
+	struct	timeval p_starttime;
+	void	*p_vmspace;
+	int	p_flag;
+	char	p_stat;
+	pid_t	p_pid;
+	u_int	p_estcpu;
+	int	p_cpticks;
+	fixpt_t	p_pctcpu;
+	void	*p_wchan;
+	char	*p_wmesg;
+	u_int	p_swtime;
+	u_int	p_slptime;
+	int	p_traceflag;
+	void	*p_tracep;
+	int	p_siglist;
+	uint32_t p_sigmask;
+	u_char	p_priority;
+	u_char	p_usrpri;
+	char	p_nice;
+	char	p_comm[MAXCOMLEN + 1];
+	u_short	p_xstat;
+	u_short	p_acflag;
+	struct	rusage *p_ru;
+};
+
+struct _pcred {
+	uid_t	p_ruid;
+	uid_t	p_svuid;
+	gid_t	p_rgid;
+	gid_t	p_svgid;
+};
+
+struct _ucred {
+	uid_t	cr_uid;
+	gid_t	cr_gid;
+};
+
+struct eproc {
+	u_long	e_paddr;
+	u_long	e_sess;			/* session id, not a pointer */
+	struct	_pcred e_pcred;
+	struct	_ucred e_ucred;
+	pid_t	e_ppid;
+	pid_t	e_pgid;
+	short	e_jobc;
+	dev_t	e_tdev;
+	pid_t	e_tpgid;
+	u_long	e_tsess;
+	char	e_wmesg[WMESGLEN + 1];
+	int	e_flag;
+};
+
+/*
+ * Raw /proc/<pid>/stat and status values that have no home in extern_proc
+ * or eproc, kept for procfs_taskinfo() and the rusage columns.
+ */
+struct procstat {
+	char	ps_state;		/* R, S, D, T, Z, ... */
+	int	ps_priority;
+	int	ps_policy;
+	long	ps_nthreads;
+	unsigned long long ps_utime;	/* clock ticks */
+	unsigned long long ps_stime;
+	unsigned long long ps_start;	/* clock ticks after boot */
+	unsigned long ps_minflt;
+	unsigned long ps_majflt;
+	long	ps_nvcsw;		/* from status */
+	long	ps_nivcsw;
+};
+
+/* proc_pidinfo(PROC_PIDWORKQUEUEINFO), see SRC_WQ. */
+struct proc_workqueueinfo {
+	uint32_t pwq_nthreads;
+	uint32_t pwq_runthreads;
+	uint32_t pwq_blockedthreads;
+	uint32_t pwq_state;
+};
+
+#define	WQ_EXCEEDED_CONSTRAINED_THREAD_LIMIT	0x1
+#define	WQ_EXCEEDED_TOTAL_THREAD_LIMIT		0x2
+
+struct kinfo_proc {
+	struct	extern_proc kp_proc;
+	struct	eproc kp_eproc;
+	struct	procstat kp_stat;
+};
+
+/*
+ * Mach task and thread information.
+ */
+typedef int	integer_t;
+typedef int	policy_t;
+typedef int	task_port_t;
+typedef int	*thread_port_array_t;
+
+typedef struct time_value {
+	integer_t seconds;
+	integer_t microseconds;
+} time_value_t;
+
+#define	time_value_add(result, addend) do {				\
+	(result)->microseconds += (addend)->microseconds;		\
+	(result)->seconds += (addend)->seconds;				\
+	if ((result)->microseconds >= 1000000) {			\
+		(result)->microseconds -= 1000000;			\
+		(result)->seconds++;					\
+	}								\
+} while (0)
+
+#define	POLICY_TIMESHARE	1
+#define	POLICY_RR		2
+#define	POLICY_FIFO		4
+
+struct policy_timeshare_info {
+	integer_t max_priority;
+	integer_t base_priority;
+	integer_t cur_priority;
+	int	depressed;
+	integer_t depress_priority;
+};
+
+struct policy_rr_info {
+	integer_t max_priority;
+	integer_t base_priority;
+	integer_t quantum;
+	int	depressed;
+	integer_t depress_priority;
+};
+
+struct policy_fifo_info {
+	integer_t max_priority;
+	integer_t base_priority;
+	int	depressed;
+	integer_t depress_priority;
+};
+
+struct task_basic_info {
+	integer_t suspend_count;
+	uint64_t virtual_size;
+	uint64_t resident_size;
+	time_value_t user_time;
+	time_value_t system_time;
+	policy_t policy;
+};
+
+struct task_thread_times_info {
+	time_value_t user_time;
+	time_value_t system_time;
+};
+
+#define	TH_STATE_RUNNING	1
+#define	TH_STATE_STOPPED	2
+#define	TH_STATE_WAITING	3
+#define	TH_STATE_UNINTERRUPTIBLE 4
+#define	TH_STATE_HALTED		5
+
+#define	TH_FLAGS_SWAPPED	0x1
+#define	TH_FLAGS_IDLE		0x2
+
+#define	TH_USAGE_SCALE		1000
+
+struct thread_basic_info {
+	time_value_t user_time;
+	time_value_t system_time;
+	integer_t cpu_usage;
+	policy_t policy;
+	integer_t run_state;
+	integer_t flags;
+	integer_t suspend_count;
+	integer_t sleep_time;
+};
+
+/* Neither glibc nor libbsd has devname(3); see procfs.c. */
+char	*devname(dev_t, mode_t);
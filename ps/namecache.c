@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Name resolution cache for user, group and terminal names.
+ *
+ * The output routines want a name for the uid and tty of every row, and
+ * the -G/-U/-u selectors want an id for every name given.  With a
+ * directory service behind getpwuid(3) each of those can be a round trip,
+ * so each answer (including "no such id") is kept here for the life of
+ * the process.  namecache_prime() resolves the distinct ids of a snapshot
+ * in one pass before anything is printed.
+ *
+ * If PS_NAMECACHE names a file, the user and group entries are also
+ * loaded from and saved to it, so that the next ps starts warm.  The file
+ * is only trusted while the modification times of /etc/passwd and
+ * /etc/group match the ones it was written with.  Terminal names are
+ * never saved; ptys come and go too quickly.
+ *
+ * Only the main thread uses the cache.
+ */
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <grp.h>
+#include <limits.h>
+#include <pwd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ps.h"
+
+#define	NC_MAGIC	"ps-namecache 1"
+
+#ifndef _PATH_PASSWD
+#define	_PATH_PASSWD	"/etc/passwd"
+#endif
+#ifndef _PATH_GROUP
+#define	_PATH_GROUP	"/etc/group"
+#endif
+
+struct ncent {
+	uint64_t key;
+	char	*name;			/* NULL if the id has no name */
+	int	used;
+};
+
+struct nctable {
+	struct ncent *ent;
+	size_t	size;			/* a power of two */
+	size_t	count;
+};
+
+static struct nctable uidtab, gidtab, ttytab;
+static int	 ncloaded;
+static int	 ncdirty;		/* entries not yet in the file */
+static struct timespec pwmtime, grmtime;
+
+static struct ncent *
+nc_slot(struct nctable *t, uint64_t key)
+{
+	size_t i;
+
+	i = (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & (t->size - 1);
+	while (t->ent[i].used && t->ent[i].key != key)
+		i = (i + 1) & (t->size - 1);
+	return (&t->ent[i]);
+}
+
+static struct ncent *
+nc_find(struct nctable *t, uint64_t key)
+{
+	struct ncent *e;
+
+	if (t->size == 0)
+		return (NULL);
+	e = nc_slot(t, key);
+	return (e->used ? e : NULL);
+}
+
+static void
+nc_insert(struct nctable *t, uint64_t key, const char *name)
+{
+	struct nctable nt;
+	struct ncent *e;
+	size_t i;
+
+	if (t->count * 2 >= t->size) {
+		nt.size = t->size ? t->size * 2 : 64;
+		nt.count = 0;
+		if ((nt.ent = calloc(nt.size, sizeof(*nt.ent))) == NULL)
+			errx(1, "malloc failed");
+		for (i = 0; i < t->size; i++)
+			if (t->ent[i].used) {
+				*nc_slot(&nt, t->ent[i].key) = t->ent[i];
+				nt.count++;
+			}
+		free(t->ent);
+		*t = nt;
+	}
+	e = nc_slot(t, key);
+	if (e->used)
+		free(e->name);
+	else
+		t->count++;
+	e->used = 1;
+	e->key = key;
+	e->name = NULL;
+	if (name != NULL && (e->name = strdup(name)) == NULL)
+		errx(1, "malloc failed");
+}
+
+static const char *
+nc_path(void)
+{
+	const char *path;
+
+	if (issetugid() || (path = getenv("PS_NAMECACHE")) == NULL ||
+	    *path == '\0')
+		return (NULL);
+	return (path);
+}
+
+static void
+nc_mtime(const char *file, struct timespec *ts)
+{
+	struct stat sb;
+
+	if (stat(file, &sb) == -1)
+		memset(ts, 0, sizeof(*ts));
+	else
+#ifdef __APPLE__
+		*ts = sb.st_mtimespec;
+#else
+		*ts = sb.st_mtim;
+#endif
+}
+
+/*
+ * Read the saved entries, if there are any and they are still current.
+ * A file that does not parse is ignored, and so is one that someone else
+ * could have written, since it decides what names ps shows.
+ */
+static void
+nc_load(void)
+{
+	const char *path;
+	struct stat sb;
+	FILE *fp;
+	char line[MAXLOGNAME + 64], *name, kind;
+	long long pws, pwn, grs, grn;
+	unsigned long long id;
+	int off;
+
+	ncloaded = 1;
+	if ((path = nc_path()) == NULL)
+		return;
+	nc_mtime(_PATH_PASSWD, &pwmtime);
+	nc_mtime(_PATH_GROUP, &grmtime);
+	if ((fp = fopen(path, "r")) == NULL) {
+		ncdirty = 1;
+		return;
+	}
+	if (fstat(fileno(fp), &sb) == -1 || !S_ISREG(sb.st_mode) ||
+	    (sb.st_uid != getuid() && sb.st_uid != 0) ||
+	    (sb.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+	    fgets(line, sizeof(line), fp) == NULL ||
+	    strncmp(line, NC_MAGIC " ", sizeof(NC_MAGIC)) != 0 ||
+	    sscanf(line + sizeof(NC_MAGIC), "%lld.%lld %lld.%lld",
+	    &pws, &pwn, &grs, &grn) != 4 ||
+	    pws != pwmtime.tv_sec || pwn != pwmtime.tv_nsec ||
+	    grs != grmtime.tv_sec || grn != grmtime.tv_nsec) {
+		(void)fclose(fp);
+		ncdirty = 1;
+		return;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		off = 0;
+		if (sscanf(line, "%c %llu %n", &kind, &id, &off) != 2 ||
+		    off == 0)
+			continue;
+		name = line + off;
+		name[strcspn(name, "\n")] = '\0';
+		if (*name == '\0')
+			continue;
+		if (kind == 'u')
+			nc_insert(&uidtab, id, name);
+		else if (kind == 'g')
+			nc_insert(&gidtab, id, name);
+	}
+	(void)fclose(fp);
+}
+
+/*
+ * Write the user and group entries back, through a temporary file so
+ * that a concurrent ps never reads half a cache.  Failure is silent; the
+ * cache is only an optimization.
+ */
+static void
+nc_save(void)
+{
+	const char *path;
+	char tmp[PATH_MAX];
+	FILE *fp;
+	size_t i;
+	int fd;
+
+	ncdirty = 0;
+	if ((path = nc_path()) == NULL)
+		return;
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+		return;
+	if ((fd = mkstemp(tmp)) == -1)
+		return;
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		(void)close(fd);
+		(void)unlink(tmp);
+		return;
+	}
+	(void)fprintf(fp, "%s %lld.%ld %lld.%ld\n", NC_MAGIC,
+	    (long long)pwmtime.tv_sec, (long)pwmtime.tv_nsec,
+	    (long long)grmtime.tv_sec, (long)grmtime.tv_nsec);
+	for (i = 0; i < uidtab.size; i++)
+		if (uidtab.ent[i].used && uidtab.ent[i].name != NULL)
+			(void)fprintf(fp, "u %llu %s\n",
+			    (unsigned long long)uidtab.ent[i].key,
+			    uidtab.ent[i].name);
+	for (i = 0; i < gidtab.size; i++)
+		if (gidtab.ent[i].used && gidtab.ent[i].name != NULL)
+			(void)fprintf(fp, "g %llu %s\n",
+			    (unsigned long long)gidtab.ent[i].key,
+			    gidtab.ent[i].name);
+	if (fclose(fp) != 0 || rename(tmp, path) == -1)
+		(void)unlink(tmp);
+}
+
+static struct ncent *
+nc_uid(uid_t uid)
+{
+	struct passwd *pw;
+	struct ncent *e;
+
+	if (!ncloaded)
+		nc_load();
+	if ((e = nc_find(&uidtab, uid)) == NULL) {
+		pw = getpwuid(uid);
+		nc_insert(&uidtab, uid, pw != NULL ? pw->pw_name : NULL);
+		if (pw != NULL)
+			ncdirty = 1;
+		e = nc_find(&uidtab, uid);
+	}
+	return (e);
+}
+
+static struct ncent *
+nc_gid(gid_t gid)
+{
+	struct group *gr;
+	struct ncent *e;
+
+	if (!ncloaded)
+		nc_load();
+	if ((e = nc_find(&gidtab, gid)) == NULL) {
+		gr = getgrgid(gid);
+		nc_insert(&gidtab, gid, gr != NULL ? gr->gr_name : NULL);
+		if (gr != NULL)
+			ncdirty = 1;
+		e = nc_find(&gidtab, gid);
+	}
+	return (e);
+}
+
+/*
+ * The name of uid, like user_from_uid(3): if it has none, NULL when
+ * nouser is set and the number as a string otherwise.
+ */
+const char *
+nc_user(uid_t uid, int nouser)
+{
+	static char buf[24];
+	struct ncent *e;
+
+	e = nc_uid(uid);
+	if (e->name != NULL || nouser)
+		return (e->name);
+	(void)snprintf(buf, sizeof(buf), "%u", (unsigned)uid);
+	return (buf);
+}
+
+const char *
+nc_group(gid_t gid, int nogroup)
+{
+	static char buf[24];
+	struct ncent *e;
+
+	e = nc_gid(gid);
+	if (e->name != NULL || nogroup)
+		return (e->name);
+	(void)snprintf(buf, sizeof(buf), "%u", (unsigned)gid);
+	return (buf);
+}
+
+/* The devname(3) of a terminal, or NULL. */
+const char *
+nc_tty(dev_t dev)
+{
+	struct ncent *e;
+
+	if ((e = nc_find(&ttytab, (uint64_t)dev)) == NULL) {
+		nc_insert(&ttytab, (uint64_t)dev, devname(dev, S_IFCHR));
+		e = nc_find(&ttytab, (uint64_t)dev);
+	}
+	return (e->name);
+}
+
+/*
+ * Look a user up by name, trying the cache before getpwnam(3).  Returns
+ * 0 and sets *uidp on success.
+ */
+int
+nc_uid_by_name(const char *name, uid_t *uidp)
+{
+	struct passwd *pw;
+	size_t i;
+
+	if (!ncloaded)
+		nc_load();
+	for (i = 0; i < uidtab.size; i++)
+		if (uidtab.ent[i].used && uidtab.ent[i].name != NULL &&
+		    strcmp(uidtab.ent[i].name, name) == 0) {
+			*uidp = (uid_t)uidtab.ent[i].key;
+			return (0);
+		}
+	if ((pw = getpwnam(name)) == NULL)
+		return (-1);
+	nc_insert(&uidtab, pw->pw_uid, pw->pw_name);
+	ncdirty = 1;
+	*uidp = pw->pw_uid;
+	return (0);
+}
+
+int
+nc_gid_by_name(const char *name, gid_t *gidp)
+{
+	struct group *gr;
+	size_t i;
+
+	if (!ncloaded)
+		nc_load();
+	for (i = 0; i < gidtab.size; i++)
+		if (gidtab.ent[i].used && gidtab.ent[i].name != NULL &&
+		    strcmp(gidtab.ent[i].name, name) == 0) {
+			*gidp = (gid_t)gidtab.ent[i].key;
+			return (0);
+		}
+	if ((gr = getgrnam(name)) == NULL)
+		return (-1);
+	nc_insert(&gidtab, gr->gr_gid, gr->gr_name);
+	ncdirty = 1;
+	*gidp = gr->gr_gid;
+	return (0);
+}
+
+/*
+ * Resolve, once each, the ids the selected columns will ask for in this
+ * snapshot, then write back whatever was new.
+ */
+void
+namecache_prime(KINFO *ki, int n)
+{
+	struct eproc *ep;
+	int i, j, uid, ruid, tty;
+
+	uid = ruid = tty = 0;
+	for (j = 0; j < nfields; j++) {
+		if (fields[j].v->oproc == uname ||
+		    fields[j].v->oproc == logname)
+			uid = 1;
+		else if (fields[j].v->oproc == runame)
+			ruid = 1;
+		else if (fields[j].v->oproc == tname ||
+		    fields[j].v->oproc == longtname)
+			tty = 1;
+	}
+	for (i = 0; i < n; i++) {
+		ep = KI_EPROC(&ki[i]);
+		if (uid)
+			(void)nc_uid(ep->e_ucred.cr_uid);
+		if (ruid)
+			(void)nc_uid(ep->e_pcred.p_ruid);
+		if (tty && ep->e_tdev != NODEV)
+			(void)nc_tty(ep->e_tdev);
+	}
+	if (ncdirty)
+		nc_save();
+}
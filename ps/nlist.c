@@ -37,12 +37,18 @@ static char sccsid[] = "@(#)nlist.c	8.4 (Berkeley) 4/2/94";
 __FBSDID("$FreeBSD: src/bin/ps/nlist.c,v 1.21 2004/04/06 20:06:49 markm Exp $");
 
 #include <sys/types.h>
+#ifndef __linux__
 #include <sys/sysctl.h>
+#endif
 #ifdef __APPLE__
 #include <sys/resource.h>
 #endif
 
 #include <stddef.h>
+#include <stdio.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
 
 #include "ps.h"
 
@@ -61,7 +67,9 @@ donlist(void)
 #ifdef __APPLE__
 	int mib[2];
 #endif
+#ifndef __linux__
 	size_t oldlen;
+#endif
 
 #ifdef __APPLE__
 	mib[0] = CTL_HW;
@@ -70,6 +78,11 @@ donlist(void)
 	if (sysctl(mib, 2, &mempages, &oldlen, NULL, 0) == -1)
 		return (1);
 	fscale = 100;
+#elif defined(__linux__)
+	/* Like HW_MEMSIZE, this is in bytes despite the name. */
+	mempages = (unsigned long)sysconf(_SC_PHYS_PAGES) *
+	    (unsigned long)sysconf(_SC_PAGESIZE);
+	fscale = 100;
 #else
 	oldlen = sizeof(ccpu);
 	if (sysctlbyname("kern.ccpu", &ccpu, &oldlen, NULL, 0) == -1)
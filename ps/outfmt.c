@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Machine-readable output (--format=json|csv|tsv|bin).
+ *
+ * Column widths are not computed in these formats (every VAR's width is
+ * 0), so the usual output routines print their values unpadded.  Each
+ * cell is rendered into a scratch stream, trimmed, and written out with
+ * the quoting its format needs:
+ *
+ *	json	one object per process, keyed by column header
+ *	csv	RFC 4180, header row first
+ *	tsv	header row first; tab, newline, CR and backslash escaped
+ *	bin	each row is a 4-byte big-endian field count followed by,
+ *		for each field, a 4-byte big-endian length and the bytes;
+ *		the first row is the header
+ *
+ * Output is fully buffered.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps.h"
+
+int	 outstyle = OUT_TEXT;
+
+static FILE	*cellfp;		/* cells are rendered here */
+static char	*cellbuf;
+static size_t	 cellsize;
+
+struct cell {
+	off_t	start;
+	off_t	end;
+	const char *name;		/* column header, blanks trimmed */
+	size_t	namelen;
+};
+static struct cell *cells;
+static int	 ncells;
+
+int
+outfmt_parse(const char *name)
+{
+	static const struct {
+		const char *name;
+		int style;
+	} styles[] = {
+		{ "text", OUT_TEXT },
+		{ "json", OUT_JSON },
+		{ "csv", OUT_CSV },
+		{ "tsv", OUT_TSV },
+		{ "bin", OUT_BIN },
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(styles) / sizeof(styles[0]); i++)
+		if (strcmp(name, styles[i].name) == 0)
+			return (styles[i].style);
+	return (-1);
+}
+
+/*
+ * Get ready to write machine-readable output: no widths, no truncation,
+ * and a large output buffer.
+ */
+void
+outfmt_init(void)
+{
+	struct varent *vent;
+	const char *name;
+	size_t len;
+	int n;
+
+	n = 0;
+	STAILQ_FOREACH(vent, &varlist, next_ve) {
+		vent->var->width = 0;
+		n++;
+	}
+	if ((cells = calloc(n, sizeof(*cells))) == NULL)
+		errx(1, "malloc failed");
+	ncells = n;
+	n = 0;
+	STAILQ_FOREACH(vent, &varlist, next_ve) {
+		name = vent->header;
+		while (*name == ' ')
+			name++;
+		if (*name == '\0')
+			name = vent->var->name;
+		len = strlen(name);
+		while (len > 0 && name[len - 1] == ' ')
+			len--;
+		cells[n].name = name;
+		cells[n].namelen = len;
+		n++;
+	}
+	if ((cellfp = open_memstream(&cellbuf, &cellsize)) == NULL)
+		err(1, "open_memstream");
+	termwidth = UNLIMITED;
+	(void)setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+}
+
+static void
+put_be32(FILE *fp, uint32_t v)
+{
+	(void)putc((v >> 24) & 0xff, fp);
+	(void)putc((v >> 16) & 0xff, fp);
+	(void)putc((v >> 8) & 0xff, fp);
+	(void)putc(v & 0xff, fp);
+}
+
+/*
+ * Length of the well-formed UTF-8 sequence at s, or 0.
+ */
+static size_t
+utf8_len(const unsigned char *s, size_t len)
+{
+	size_t n, i;
+
+	if (s[0] < 0xc2 || s[0] > 0xf4)
+		return (0);
+	n = s[0] < 0xe0 ? 2 : s[0] < 0xf0 ? 3 : 4;
+	if (n > len)
+		return (0);
+	for (i = 1; i < n; i++)
+		if ((s[i] & 0xc0) != 0x80)
+			return (0);
+	return (n);
+}
+
+static void
+put_json_string(FILE *fp, const char *s, size_t len)
+{
+	const unsigned char *cp = (const unsigned char *)s;
+	const unsigned char *ep = cp + len;
+	size_t n;
+
+	(void)putc('"', fp);
+	while (cp < ep) {
+		switch (*cp) {
+		case '"':
+		case '\\':
+			(void)putc('\\', fp);
+			(void)putc(*cp, fp);
+			break;
+		case '\n':
+			(void)fputs("\\n", fp);
+			break;
+		case '\r':
+			(void)fputs("\\r", fp);
+			break;
+		case '\t':
+			(void)fputs("\\t", fp);
+			break;
+		default:
+			if (*cp < 0x20 || *cp == 0x7f) {
+				(void)fprintf(fp, "\\u%04x", *cp);
+			} else if (*cp >= 0x80) {
+				/* Not valid UTF-8: substitute U+FFFD. */
+				if ((n = utf8_len(cp, ep - cp)) == 0) {
+					(void)fputs("\\ufffd", fp);
+					break;
+				}
+				(void)fwrite(cp, 1, n, fp);
+				cp += n;
+				continue;
+			} else
+				(void)putc(*cp, fp);
+			break;
+		}
+		cp++;
+	}
+	(void)putc('"', fp);
+}
+
+/*
+ * Does s look like a JSON number?  Values such as "0:01.23" or "007"
+ * stay strings.
+ */
+static int
+is_json_number(const char *s, size_t len)
+{
+	size_t i = 0;
+
+	if (i < len && s[i] == '-')
+		i++;
+	if (i == len || s[i] < '0' || s[i] > '9')
+		return (0);
+	if (s[i] == '0' && i + 1 < len && s[i + 1] != '.')
+		return (0);
+	while (i < len && s[i] >= '0' && s[i] <= '9')
+		i++;
+	if (i < len && s[i] == '.') {
+		if (++i == len)
+			return (0);
+		while (i < len && s[i] >= '0' && s[i] <= '9')
+			i++;
+	}
+	return (i == len);
+}
+
+static void
+put_csv(FILE *fp, const char *s, size_t len)
+{
+	size_t i;
+
+	if (len > 0 && strcspn(s, ",\"\r\n") >= len && s[0] != ' ' &&
+	    s[len - 1] != ' ') {
+		(void)fwrite(s, 1, len, fp);
+		return;
+	}
+	(void)putc('"', fp);
+	for (i = 0; i < len; i++) {
+		if (s[i] == '"')
+			(void)putc('"', fp);
+		(void)putc(s[i], fp);
+	}
+	(void)putc('"', fp);
+}
+
+static void
+put_tsv(FILE *fp, const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		switch (s[i]) {
+		case '\t':
+			(void)fputs("\\t", fp);
+			break;
+		case '\n':
+			(void)fputs("\\n", fp);
+			break;
+		case '\r':
+			(void)fputs("\\r", fp);
+			break;
+		case '\\':
+			(void)fputs("\\\\", fp);
+			break;
+		default:
+			(void)putc(s[i], fp);
+			break;
+		}
+	}
+}
+
+/*
+ * Write one field.  i is its column number.
+ */
+static void
+put_field(FILE *fp, int i, const char *s, size_t len)
+{
+	switch (outstyle) {
+	case OUT_JSON:
+		(void)fputs(i == 0 ? "{" : ",", fp);
+		put_json_string(fp, cells[i].name, cells[i].namelen);
+		(void)putc(':', fp);
+		if (is_json_number(s, len))
+			(void)fwrite(s, 1, len, fp);
+		else
+			put_json_string(fp, s, len);
+		break;
+	case OUT_CSV:
+		if (i > 0)
+			(void)putc(',', fp);
+		put_csv(fp, s, len);
+		break;
+	case OUT_TSV:
+		if (i > 0)
+			(void)putc('\t', fp);
+		put_tsv(fp, s, len);
+		break;
+	case OUT_BIN:
+		if (i == 0)
+			put_be32(fp, ncells);
+		put_be32(fp, (uint32_t)len);
+		(void)fwrite(s, 1, len, fp);
+		break;
+	}
+}
+
+static void
+end_row(FILE *fp)
+{
+	switch (outstyle) {
+	case OUT_JSON:
+		(void)fputs(ncells > 0 ? "}\n" : "{}\n", fp);
+		break;
+	case OUT_CSV:
+		(void)fputs("\r\n", fp);
+		break;
+	case OUT_TSV:
+		(void)putc('\n', fp);
+		break;
+	}
+}
+
+/*
+ * The header row (not written for json, whose keys are the headers).
+ */
+void
+outfmt_header(FILE *fp)
+{
+	int i;
+
+	if (outstyle == OUT_JSON)
+		return;
+	for (i = 0; i < ncells; i++)
+		put_field(fp, i, cells[i].name, cells[i].namelen);
+	end_row(fp);
+}
+
+/*
+ * Render one row through the output routines and write it to fp.
+ */
+void
+outfmt_row(KINFO *k, FILE *fp)
+{
+	const char *s;
+	size_t len;
+	int i;
+
+	rewind(cellfp);
+	psout = cellfp;
+	for (i = 0; i < nfields; i++) {
+		cells[i].start = ftello(cellfp);
+		(fields[i].print)(k, &fields[i]);
+		cells[i].end = ftello(cellfp);
+	}
+	(void)fflush(cellfp);
+	psout = fp;
+
+	for (i = 0; i < ncells; i++) {
+		s = cellbuf + cells[i].start;
+		len = cells[i].end - cells[i].start;
+		/* Drop what padding the output routine still added. */
+		while (len > 0 && *s == ' ') {
+			s++;
+			len--;
+		}
+		while (len > 0 && s[len - 1] == ' ')
+			len--;
+		put_field(fp, i, s, len);
+	}
+	end_row(fp);
+}
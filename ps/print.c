@@ -42,32 +42,34 @@ static const char rcsid[] =
 #include <sys/param.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#ifndef __linux__
 #include <sys/ucred.h>
 #include <sys/proc.h>
+#endif /* !__linux__ */
 #include <sys/stat.h>
 
+#ifndef __linux__
 #include <sys/ucred.h>
 #include <sys/user.h>
 #include <sys/sysctl.h>
+#endif /* !__linux__ */
 #include <sys/cdefs.h>
 
-#ifdef __APPLE__
-#include <System/sys/persona.h>
-#endif /* __APPLE__ */
-
 #if FIXME
 #include <vm/vm.h>
 #endif /* FIXME */
 #include <err.h>
 #include <langinfo.h>
-#include <libproc.h>
 #include <math.h>
+#ifndef __linux__
 #include <nlist.h>
+#endif /* !__linux__ */
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <vis.h>
 #include <pwd.h>
 
@@ -75,6 +77,15 @@ static const char rcsid[] =
 
 extern int mflg, print_all_thread, print_thread_num;
 
+FIELD	*fields;		/* the compiled varlist */
+int	 nfields;
+
+/*
+ * Precision for a truncated column.  Machine-readable output has no
+ * widths and truncates nothing; a negative precision is ignored.
+ */
+#define	PREC(v)	((v)->width > 0 ? (v)->width : -1)
+
 void
 printheader(void)
 {
@@ -87,19 +98,45 @@ printheader(void)
 	if (!vent)
 		return;
 
+	if (outstyle != OUT_TEXT) {
+		outfmt_header(psout);
+		return;
+	}
 	STAILQ_FOREACH(vent, &varlist, next_ve) {
 		v = vent->var;
 		if (v->flag & LJUST) {
 			if (STAILQ_NEXT(vent, next_ve) == NULL)	/* last one */
-				(void)printf("%s", vent->header);
+				(void)fprintf(psout, "%s", vent->header);
 			else
-				(void)printf("%-*s", v->width, vent->header);
+				(void)fprintf(psout, "%-*s", v->width, vent->header);
 		} else
-			(void)printf("%*s", v->width, vent->header);
+			(void)fprintf(psout, "%*s", v->width, vent->header);
 		if (STAILQ_NEXT(vent, next_ve) != NULL)
-			(void)putchar(' ');
+			(void)putc(' ', psout);
+	}
+	(void)putc('\n', psout);
+}
+
+/*
+ * Print one line: the current thread of k with -M, otherwise k itself.
+ */
+void
+printrow(KINFO *k)
+{
+
+	const FIELD *f, *end;
+
+	if (outstyle != OUT_TEXT) {
+		outfmt_row(k, psout);
+		return;
+	}
+	end = fields + nfields;
+	for (f = fields; f < end; f++) {
+		if (f != fields)
+			(void)putc(' ', psout);
+		(f->print)(k, f);
 	}
-	(void)putchar('\n');
+	(void)putc('\n', psout);
 }
 
 /*
@@ -110,12 +147,17 @@ printheader(void)
  *
  * on return argvlen is the length of the extracted string, argv0len is
  * the length of the command (same as argvlen if show_args is true)
+ *
+ * The raw argument area is fetched by get_procargs(), normally already
+ * from collect_procs(), and kept in the KINFO.  It is not modified here,
+ * so the sizing and printing passes (and several command/args columns)
+ * can all be rendered from the one copy.
  */
 static void
 getproclline(KINFO *k, char **command_name, int *argvlen, int *argv0len,
   int show_args)
 {
-	int		mib[3], argmax, nargs, c = 0;
+	int		nargs, c = 0;
 	size_t		size;
 	char		*procargs, *sp, *np, *cp;
 	extern int	eflg;
@@ -125,75 +167,25 @@ getproclline(KINFO *k, char **command_name, int *argvlen, int *argv0len,
 	 * anything else; it's simply marked defunct.
 	 */
 	if (KI_PROC(k)->p_stat == SZOMB) {
-		*argv0len = *argvlen = asprintf(command_name, "<defunct>");
+		*command_name = arena_printf(curarena, argvlen, "<defunct>");
+		*argv0len = *argvlen;
 		return;
 	}
 
-	/* Get the maximum process arguments size. */
-	mib[0] = CTL_KERN;
-	mib[1] = KERN_ARGMAX;
-
-	size = sizeof(argmax);
-	if (sysctl(mib, 2, &argmax, &size, NULL, 0) == -1) {
+	/*
+	 * Get the raw argument space of the process, in KERN_PROCARGS2
+	 * layout; see sysctl_procargs() in tasks.c.
+	 */
+	get_procargs(k);
+	if (k->ki_procargsok < 0) {
 		goto ERROR_A;
 	}
-
-	/* Allocate space for the arguments. */
-	procargs = (char *)malloc(argmax);
-	if (procargs == NULL) {
+	procargs = k->ki_procargs;
+	size = k->ki_procargsize;
+	if (size < sizeof(nargs)) {
 		goto ERROR_A;
 	}
 
-	/*
-	 * Make a sysctl() call to get the raw argument space of the process.
-	 * The layout is documented in start.s, which is part of the Csu
-	 * project.  In summary, it looks like:
-	 *
-	 * /---------------\ 0x00000000
-	 * :               :
-	 * :               :
-	 * |---------------|
-	 * | argc          |
-	 * |---------------|
-	 * | arg[0]        |
-	 * |---------------|
-	 * :               :
-	 * :               :
-	 * |---------------|
-	 * | arg[argc - 1] |
-	 * |---------------|
-	 * | 0             |
-	 * |---------------|
-	 * | env[0]        |
-	 * |---------------|
-	 * :               :
-	 * :               :
-	 * |---------------|
-	 * | env[n]        |
-	 * |---------------|
-	 * | 0             |
-	 * |---------------| <-- Beginning of data returned by sysctl() is here.
-	 * | argc          |
-	 * |---------------|
-	 * | exec_path     |
-	 * |:::::::::::::::|
-	 * |               |
-	 * | String area.  |
-	 * |               |
-	 * |---------------| <-- Top of stack.
-	 * :               :
-	 * :               :
-	 * \---------------/ 0xffffffff
-	 */
-	mib[0] = CTL_KERN;
-	mib[1] = KERN_PROCARGS2;
-	mib[2] = KI_PROC(k)->p_pid;
-
-	size = (size_t)argmax;
-	if (sysctl(mib, 3, procargs, &size, NULL, 0) == -1) {
-		goto ERROR_B;
-	}
-
 	memcpy(&nargs, procargs, sizeof(nargs));
 	cp = procargs + sizeof(nargs);
 
@@ -205,7 +197,7 @@ getproclline(KINFO *k, char **command_name, int *argvlen, int *argv0len,
 		}
 	}
 	if (cp == &procargs[size]) {
-		goto ERROR_B;
+		goto ERROR_A;
 	}
 
 	/* Skip trailing '\0' characters. */
@@ -216,25 +208,23 @@ getproclline(KINFO *k, char **command_name, int *argvlen, int *argv0len,
 		}
 	}
 	if (cp == &procargs[size]) {
-		goto ERROR_B;
+		goto ERROR_A;
 	}
 	/* Save where the argv[0] string starts. */
 	sp = cp;
 
 	/*
-	 * Iterate through the '\0'-terminated strings and convert '\0' to ' '
-	 * until a string is found that has a '=' character in it (or there are
-	 * no more strings in procargs).  There is no way to deterministically
-	 * know where the command arguments end and the environment strings
-	 * start, which is why the '=' character is searched for as a heuristic.
+	 * Walk the '\0'-terminated strings until a string is found that has a
+	 * '=' character in it (or there are no more strings in procargs).
+	 * There is no way to deterministically know where the command
+	 * arguments end and the environment strings start, which is why the
+	 * '=' character is searched for as a heuristic.  Every '\0' before np
+	 * becomes a ' ' in the copy made below.
 	 */
 	for (np = NULL; c < nargs && cp < &procargs[size]; cp++) {
 		if (*cp == '\0') {
 			c++;
-			if (np != NULL) {
-			    /* Convert previous '\0'. */
-			    *np = ' ';
-			} else {
+			if (np == NULL) {
 			    *argv0len = cp - sp;
 			}
 			/* Note location of current '\0'. */
@@ -242,10 +232,8 @@ getproclline(KINFO *k, char **command_name, int *argvlen, int *argv0len,
 
 			if (!show_args) {
 			    /*
-			     * Don't convert '\0' characters to ' '.
-			     * However, we needed to know that the
-			     * command name was terminated, which we
-			     * now know.
+			     * We needed to know that the command name
+			     * was terminated, which we now know.
 			     */
 			    break;
 			}
@@ -253,26 +241,20 @@ getproclline(KINFO *k, char **command_name, int *argvlen, int *argv0len,
 	}
 
 	/*
-	 * If eflg is non-zero, continue converting '\0' characters to ' '
-	 * characters until no more strings that look like environment settings
-	 * follow.
+	 * If eflg is non-zero, continue until no more strings that look like
+	 * environment settings follow.
 	 */
 	if ( show_args && (eflg != 0) && ( (getuid() == 0) || (KI_EPROC(k)->e_pcred.p_ruid == getuid()) ) ) {
 		for (; cp < &procargs[size]; cp++) {
 			if (*cp == '\0') {
-				if (np != NULL) {
-					if (&np[1] == cp) {
-						/*
-						 * Two '\0' characters in a row.
-						 * This should normally only
-						 * happen after all the strings
-						 * have been seen, but in any
-						 * case, stop parsing.
-						 */
-						break;
-					}
-					/* Convert previous '\0'. */
-					*np = ' ';
+				if (np != NULL && &np[1] == cp) {
+					/*
+					 * Two '\0' characters in a row.
+					 * This should normally only happen
+					 * after all the strings have been
+					 * seen, but in any case, stop parsing.
+					 */
+					break;
 				}
 				/* Note location of current '\0'. */
 				np = cp;
@@ -286,34 +268,46 @@ getproclline(KINFO *k, char **command_name, int *argvlen, int *argv0len,
 	 */
 	if (np == NULL || np == sp) {
 		/* Empty or unterminated string. */
-		goto ERROR_B;
+		goto ERROR_A;
 	}
 
-	/* Make a copy of the string. */
-	*argvlen = asprintf(command_name, "%s", sp);
-
-	/* Clean up. */
-	free(procargs);
+	/* Make a copy of the string, joining the pieces with spaces. */
+	*argvlen = np - sp;
+	*command_name = amalloc(*argvlen + 1);
+	for (cp = *command_name; sp < np; sp++, cp++)
+		*cp = *sp != '\0' ? *sp : ' ';
+	*cp = '\0';
 	return;
 
-	ERROR_B:
-	free(procargs);
 	ERROR_A:
-	*argv0len = *argvlen 
-	  = asprintf(command_name, "(%s)", KI_PROC(k)->p_comm);
+	*command_name = arena_printf(curarena, argvlen, "(%s)",
+	    KI_PROC(k)->p_comm);
+	*argv0len = *argvlen;
 }
 
-/* Return value is malloc'ed, please free it */
-char *
-get_command_and_or_args(KINFO *k, int show_cmd, int show_args)
+/*
+ * Return the visible command and/or arguments.  The result is cached in
+ * the KINFO, keyed by show_cmd/show_args, and lives in the snapshot arena.
+ */
+static const char *
+get_command_and_or_args(KINFO *k, int show_cmd, int show_args, int *lenp)
 {
-	char *vis_args;
+	static char *vis_args;		/* strvis() scratch space */
+	static size_t vis_size;
+	size_t need;
 
 	char *rawcmd, *cmd;
 	int cmdlen, argv0len = 0;
+	int slot;
 
 
 	if(!mflg || (print_all_thread && (print_thread_num== 0))) {
+		slot = (show_cmd ? 2 : 0) | (show_args ? 1 : 0);
+		if (k->ki_cmdstr[slot] != NULL) {
+			*lenp = k->ki_cmdlen[slot];
+			return k->ki_cmdstr[slot];
+		}
+
 		getproclline(k, &rawcmd, &cmdlen, &argv0len, show_args);
 
 		if (cflag) {
@@ -335,23 +329,41 @@ get_command_and_or_args(KINFO *k, int show_cmd, int show_args)
 			}
 		}
 
-		if ((vis_args = malloc(strlen(cmd) * 4 + 1)) == NULL)
-			err(1, NULL);
-		strvis(vis_args, cmd, VIS_TAB | VIS_NL | VIS_NOSLASH);
-		free(rawcmd);
-		return vis_args;
+		if (outstyle == OUT_TEXT || outstyle == OUT_TSV) {
+			need = strlen(cmd) * 4 + 1;
+			if (need > vis_size) {
+				free(vis_args);
+				if ((vis_args = malloc(need)) == NULL)
+					err(1, NULL);
+				vis_size = need;
+			}
+			/* TSV escapes its own tabs and newlines. */
+			k->ki_cmdlen[slot] = strvis(vis_args, cmd,
+			    (outstyle == OUT_TSV ? 0 : VIS_TAB | VIS_NL) |
+			    VIS_NOSLASH);
+			cmd = vis_args;
+		} else {
+			/* The other formats quote for themselves. */
+			k->ki_cmdlen[slot] = strlen(cmd);
+		}
+		k->ki_cmdstr[slot] = arena_strndup(curarena, cmd,
+		    k->ki_cmdlen[slot]);
+		*lenp = k->ki_cmdlen[slot];
+		return k->ki_cmdstr[slot];
 	} else {
-		return strdup("");
+		*lenp = 0;
+		return "";
 	}
 }
 
 int
 s_command_and_or_args(KINFO *k, int show_cmd, int show_args)
 {
-	char *s = get_command_and_or_args(k, show_cmd, show_args);
-	int sz = strlen(s);
-	free(s);
+	int sz;
 
+	(void)get_command_and_or_args(k, show_cmd, show_args, &sz);
+	if (k->ki_prefix != NULL)
+		sz += strlen(k->ki_prefix);
 	return sz;
 }
 
@@ -360,31 +372,46 @@ p_command_and_or_args(KINFO *k, VARENT *ve, int show_cmd, int show_args,
   int no_trunc)
 {
 	VAR *v = ve->var;
-	char *s = get_command_and_or_args(k, show_cmd, show_args);
-
+	int len, plen, width;
+	const char *s = get_command_and_or_args(k, show_cmd, show_args, &len);
+
+	/* --forest: the tree goes first, in the same width. */
+	plen = 0;
+	width = v->width;
+	if (k->ki_prefix != NULL) {
+		plen = strlen(k->ki_prefix);
+		if (width > 0 && (width -= plen) < 0)
+			width = 0;
+	}
 	if (STAILQ_NEXT(ve, next_ve) == NULL) {
 		/* last field */
 		if (termwidth == UNLIMITED) {
-			fputs(s, stdout);
+			if (plen > 0)
+				fwrite(k->ki_prefix, 1, plen, psout);
+			fwrite(s, 1, len, psout);
 		} else {
 			int left;
-			char *cp;
+			const char *cp;
 
 			left = termwidth - (totwidth - v->width);
 			if (left < 1 || no_trunc) {
 				/* already wrapped, just use std * width */
 				left = v->width;
 			}
+			for (cp = k->ki_prefix; plen-- > 0 && left > 0; left--)
+				(void)putc(*cp++, psout);
 			for(cp = s; --left >= 0 && *cp;) {
-				(void)putchar(*cp++);
+				(void)putc(*cp++, psout);
 			}
 		}
 	} else {
 		/* XXX env? */
-		(void)printf("%-*.*s", v->width, v->width, s);
+		if (plen > 0)
+			(void)fprintf(psout, "%.*s", v->width > 0 ? v->width :
+			    plen, k->ki_prefix);
+		(void)fprintf(psout, "%-*.*s", width, v->width > 0 ? width : -1,
+		    s);
 	}
-
-	free(s);
 }
 
 int s_command(KINFO *k) {
@@ -419,30 +446,29 @@ ucomm(k, ve)
 	VAR *v;
 
 	v = ve->var;
-	(void)printf("%-*s", v->width, KI_PROC(k)->p_comm);
+	(void)fprintf(psout, "%-*s", v->width, KI_PROC(k)->p_comm);
 }
 
-char *getname(uid)
+const char *getname(uid)
 	uid_t	uid;
 {
-	register struct passwd *pw;
-	struct passwd *getpwuid();
+	const char *name;
 
-	pw = getpwuid((short)uid);
-	if (pw == NULL) {
+	name = nc_user(uid, 1);
+	if (name == NULL) {
 		return( "UNKNOWN" );
 	}
-	return( pw->pw_name );
+	return( name );
 }
 
 void
 logname(KINFO *k, VARENT *ve)
 {
 	VAR *v;
-	char *s;
+	const char *s;
 
 	v = ve->var;
-	(void)printf("%-*s", v->width, (s = getname(KI_EPROC(k)->e_ucred.cr_uid), *s) ? s : "-");
+	(void)fprintf(psout, "%-*s", v->width, (s = getname(KI_EPROC(k)->e_ucred.cr_uid), *s) ? s : "-");
 }
 
 extern int mach_state_order();
@@ -495,17 +521,17 @@ state(k, ve)
 	if ((flag & P_CONTROLT) && KI_EPROC(k)->e_pgid == KI_EPROC(k)->e_tpgid)
 		*cp++ = '+';
 	*cp = '\0';
-	(void)printf("%-*s", v->width, buf);
+	(void)fprintf(psout, "%-*s", v->width, buf);
 #if !PS_ENTITLEMENT_ENFORCED
 	} else if (print_all_thread) {
 		j =  mach_state_order(k->thval[print_thread_num].tb.run_state,
 			k->thval[print_thread_num].tb.sleep_time);
 		*cp++ = mach_state_table[j];
 		*cp++='\0'; 
-		(void)printf("%-*s", v->width, buf);
+		(void)fprintf(psout, "%-*s", v->width, buf);
 #endif
 	} else {
-		(void)printf("%-*s", v->width, " ");
+		(void)fprintf(psout, "%-*s", v->width, " ");
 	}
 	
 }
@@ -521,7 +547,7 @@ pri(k, ve)
 
 	v = ve->var;
 	if (!mflg ) {
-		(void)printf("%*d", v->width, k->curpri);
+		(void)fprintf(psout, "%*d", v->width, k->curpri);
 	} else if (print_all_thread) {
 		switch(k->thval[print_thread_num].tb.policy) {
 			case POLICY_TIMESHARE : 
@@ -539,10 +565,10 @@ pri(k, ve)
 			default :
 				j = 0;		
 		}
-		(void)printf("%*d%c", v->width - 1, j, c);
+		(void)fprintf(psout, "%*d%c", v->width - 1, j, c);
 	}else {
 		j=0;
-		(void)printf("%*d", v->width, j);
+		(void)fprintf(psout, "%*d", v->width, j);
 		
 	}
 }
@@ -556,17 +582,17 @@ uname(k, ve)
 
 	v = ve->var;
 	if(!mflg || (print_all_thread && (print_thread_num== 0)))
-		(void)printf("%-*s",
+		(void)fprintf(psout, "%-*s",
 	  	  (int)v->width, 
-			user_from_uid(KI_EPROC(k)->e_ucred.cr_uid, 0));
+			nc_user(KI_EPROC(k)->e_ucred.cr_uid, 0));
 	else 
-		(void)printf("%-*s", (int)v->width, " ");
+		(void)fprintf(psout, "%-*s", (int)v->width, " ");
 }
 
 int
 s_uname(KINFO *k)
 {
-	    return (strlen(user_from_uid(KI_EPROC(k)->e_ucred.cr_uid, 0)));
+	    return (strlen(nc_user(KI_EPROC(k)->e_ucred.cr_uid, 0)));
 }
 
 void
@@ -577,14 +603,14 @@ runame(k, ve)
 	VAR *v;
 
 	v = ve->var;
-	(void)printf("%-*s",
-	    (int)v->width, user_from_uid(KI_EPROC(k)->e_pcred.p_ruid, 0));
+	(void)fprintf(psout, "%-*s",
+	    (int)v->width, nc_user(KI_EPROC(k)->e_pcred.p_ruid, 0));
 }
 
 int
 s_runame(KINFO *k)
 {
-	    return (strlen(user_from_uid(KI_EPROC(k)->e_pcred.p_ruid, 0)));
+	    return (strlen(nc_user(KI_EPROC(k)->e_pcred.p_ruid, 0)));
 }
 
 void
@@ -599,11 +625,11 @@ tdev(k, ve)
 	v = ve->var;
 	dev = KI_EPROC(k)->e_tdev;
 	if (dev == NODEV)
-		(void)printf("%*s", v->width, "??");
+		(void)fprintf(psout, "%*s", v->width, "??");
 	else {
 		(void)snprintf(buff, sizeof(buff),
 		    "%d/%d", major(dev), minor(dev));
-		(void)printf("%*s", v->width, buff);
+		(void)fprintf(psout, "%*s", v->width, buff);
 	}
 }
 
@@ -614,24 +640,28 @@ tname(k, ve)
 {
 	VAR *v;
 	dev_t dev;
-	char *ttname;
+	const char *ttname;
 
 	v = ve->var;
 
 	if(!mflg || (print_all_thread && (print_thread_num== 0))) {
 	dev = KI_EPROC(k)->e_tdev;
-	if (dev == NODEV || (ttname = devname(dev, S_IFCHR)) == NULL)
-		(void)printf("%*s ", v->width-1, "??");
+	if (dev == NODEV || (ttname = nc_tty(dev)) == NULL)
+		(void)fprintf(psout, "%*s ", v->width-1, "??");
 	else {
 		if (strncmp(ttname, "tty", 3) == 0 ||
 		    strncmp(ttname, "cua", 3) == 0)
 			ttname += 3;
-		(void)printf("%*.*s%c", v->width-1, v->width-1, ttname,
+#ifdef __linux__
+		else if (strncmp(ttname, "pts/", 4) == 0)
+			ttname += 4;
+#endif
+		(void)fprintf(psout, "%*.*s%c", v->width-1, v->width-1, ttname,
 			KI_EPROC(k)->e_flag & EPROC_CTTY ? ' ' : '-');
 	}
 	}
 	else {
-		(void)printf("%*s ", v->width-1, " ");
+		(void)fprintf(psout, "%*s ", v->width-1, " ");
 	}
 }
 
@@ -642,14 +672,14 @@ longtname(k, ve)
 {
 	VAR *v;
 	dev_t dev;
-	char *ttname;
+	const char *ttname;
 
 	v = ve->var;
 	dev = KI_EPROC(k)->e_tdev;
-	if (dev == NODEV || (ttname = devname(dev, S_IFCHR)) == NULL)
-		(void)printf("%-*s", v->width, "??");
+	if (dev == NODEV || (ttname = nc_tty(dev)) == NULL)
+		(void)fprintf(psout, "%-*s", v->width, "??");
 	else
-		(void)printf("%-*s", v->width, ttname);
+		(void)fprintf(psout, "%-*s", v->width, ttname);
 }
 
 void
@@ -674,7 +704,7 @@ started(KINFO *k, VARENT *ve)
 		    use_ampm ? "%a%I%p" : "%a%H  ", tp);
 	} else
 		(void)strftime(buf, sizeof(buf), "%e%b%y", tp);
-	(void)printf("%-*s", v->width, buf);
+	(void)fprintf(psout, "%-*s", v->width, buf);
 }
 
 void
@@ -689,53 +719,50 @@ lstarted(k, ve)
 	v = ve->var;
 	then = KI_PROC(k)->p_starttime.tv_sec;
 	(void)strftime(buf, sizeof(buf) -1, "%c", localtime(&then));
-	(void)printf("%-*s", v->width, buf);
+	(void)fprintf(psout, "%-*s", v->width, buf);
 }
 
-char *get_etime(KINFO *k) {
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	long e = tv.tv_sec - KI_PROC(k)->p_starttime.tv_sec;
-	
-	char *ret;
+/*
+ * Elapsed time, measured to the time the snapshot was taken.
+ */
+static int get_etime(KINFO *k, char *buf, size_t size) {
+	long e = now - KI_PROC(k)->p_starttime.tv_sec;
 
 	if (e > 100*60*60*24) {
-		asprintf(&ret, "%ld-%02ld:%02ld:%02ld",
+		return snprintf(buf, size, "%ld-%02ld:%02ld:%02ld",
 		  e / (60*60*24),
 		  (e / (60*60)) % 24,
 		  (e / 60) % 60,
 		  e % 60);
 	} else if (e > 60*60*24) {
-		asprintf(&ret, "%02ld-%02ld:%02ld:%02ld",
+		return snprintf(buf, size, "%02ld-%02ld:%02ld:%02ld",
 		  e / (60*60*24),
 		  (e / (60*60)) % 24,
 		  (e / 60) % 60,
 		  e % 60);
 	} else if (e > 60*60) {
-		asprintf(&ret, "%02ld:%02ld:%02ld",
+		return snprintf(buf, size, "%02ld:%02ld:%02ld",
 		  (e / (60*60)),
 		  (e / 60) % 60,
 		  e % 60);
 	} else {
-		asprintf(&ret, "%02ld:%02ld",
+		return snprintf(buf, size, "%02ld:%02ld",
 		  (e / 60),
 		  e % 60);
 	}
-
-	return ret;
 }
 
 void p_etime(KINFO *k, VARENT *ve) {
-	char *str = get_etime(k);
-	printf("%*s", ve->var->width, str);
-	free(str);
+	char str[32];
+
+	(void)get_etime(k, str, sizeof(str));
+	fprintf(psout, "%*s", ve->var->width, str);
 }
 
 int s_etime(KINFO *k) {
-	char *str = get_etime(k);
-	int sz = strlen(str);
-	free(str);
-	return sz;
+	char str[32];
+
+	return get_etime(k, str, sizeof(str));
 }
 
 void
@@ -748,18 +775,18 @@ wchan(k, ve)
 	v = ve->var;
 	if (KI_PROC(k)->p_wchan) {
 		if (KI_PROC(k)->p_wmesg)
-			(void)printf("%-*.*s", v->width, v->width,
+			(void)fprintf(psout, "%-*.*s", v->width, PREC(v),
 				      KI_EPROC(k)->e_wmesg);
 		else
 #if FIXME
-			(void)printf("%-*lx", v->width,
+			(void)fprintf(psout, "%-*lx", v->width,
 			    (long)KI_PROC(k)->p_wchan &~ KERNBASE);
 #else /* FIXME */
-			(void)printf("%-*lx", v->width,
+			(void)fprintf(psout, "%-*lx", v->width,
 			    (long)KI_PROC(k)->p_wchan);
 #endif /* FIXME */
 	} else
-		(void)printf("%-*s", v->width, "-");
+		(void)fprintf(psout, "%-*s", v->width, "-");
 }
 
 #define pgtok(a)        (((a)*getpagesize())/1024)
@@ -773,10 +800,10 @@ vsize(k, ve)
 
 	v = ve->var;
 #if FIXME
-	(void)printf("%*d", v->width,
+	(void)fprintf(psout, "%*d", v->width,
 	    (KI_EPROC(k)->e_vm.vm_map.size/1024));
 #else /* FIXME */
-	(void)printf("%*lu", v->width,
+	(void)fprintf(psout, "%*lu", v->width,
 	    (u_long)((k)->tasks_info.virtual_size)/1024);
 #endif /* FIXME */
 }
@@ -790,7 +817,7 @@ p_rssize(k, ve)		/* doesn't account for text */
 /* FIXME LATER */
 	v = ve->var;
 	/* (void)printf("%*ld", v->width, "-"); */
-	(void)printf("%*lu", v->width,
+	(void)fprintf(psout, "%*lu", v->width,
 	    (u_long)((k)->tasks_info.resident_size)/1024);
 }
 
@@ -851,7 +878,7 @@ cputime(k, ve)
 #endif /* FIXME */
 	(void)snprintf(obuff, sizeof(obuff),
 	    "%3ld:%02ld.%02ld", secs/60, secs%60, psecs);
-	(void)printf("%*s", v->width, obuff);
+	(void)fprintf(psout, "%*s", v->width, obuff);
 }
 
 void
@@ -888,7 +915,7 @@ putime(k, ve)
 
 	(void)snprintf(obuff, sizeof(obuff),
 	    "%3ld:%02ld.%02ld", secs/60, secs%60, psecs);
-	(void)printf("%*s", v->width, obuff);
+	(void)fprintf(psout, "%*s", v->width, obuff);
 }
 
 void
@@ -923,7 +950,7 @@ pstime(k, ve)
 
 	(void)snprintf(obuff, sizeof(obuff),
 	    "%3ld:%02ld.%02ld", secs/60, secs%60, psecs);
-	(void)printf("%*s", v->width, obuff);
+	(void)fprintf(psout, "%*s", v->width, obuff);
 
 }
 
@@ -973,7 +1000,7 @@ pcpu(KINFO *k, VARENT *ve)
 	}
 
 	v = ve->var;
-	(void)printf("%*.1f", v->width, ((double)cp) * 100.0 / ((double)TH_USAGE_SCALE));
+	(void)fprintf(psout, "%*.1f", v->width, ((double)cp) * 100.0 / ((double)TH_USAGE_SCALE));
 }
 
 double
@@ -1011,7 +1038,7 @@ pmem(k, ve)
 	VAR *v;
 
 	v = ve->var;
-	(void)printf("%*.1f", v->width, getpmem(k));
+	(void)fprintf(psout, "%*.1f", v->width, getpmem(k));
 }
 
 void
@@ -1022,7 +1049,7 @@ pagein(k, ve)
 	VAR *v;
 
 	v = ve->var;
-	(void)printf("%*ld", v->width,
+	(void)fprintf(psout, "%*ld", v->width,
 	    k->ki_u.u_valid ? k->ki_u.u_ru.ru_majflt : 0);
 }
 
@@ -1035,7 +1062,7 @@ maxrss(k, ve)
 
 	v = ve->var;
 	/* XXX not yet */
-	(void)printf("%*s", v->width, "-");
+	(void)fprintf(psout, "%*s", v->width, "-");
 }
 
 void
@@ -1048,9 +1075,9 @@ tsize(k, ve)
 
 	v = ve->var;
 #if 0
-	(void)printf("%*ld", v->width, (long)pgtok(KI_EPROC(k)->e_vm.vm_tsize));
+	(void)fprintf(psout, "%*ld", v->width, (long)pgtok(KI_EPROC(k)->e_vm.vm_tsize));
 #else
-	(void)printf("%*ld", v->width, (long)dummy);
+	(void)fprintf(psout, "%*ld", v->width, (long)dummy);
 #endif
 }
 
@@ -1085,7 +1112,7 @@ rtprior(k, ve)
 		break;
 	}
 	str[sizeof(str) - 1] = '\0';
-	(void)printf("%*s", v->width, str);
+	(void)fprintf(psout, "%*s", v->width, str);
 #endif /* FIXME */
 }
 
@@ -1109,34 +1136,34 @@ printval(void *bp, VAR *v)
 
 	switch (v->type) {
 	case CHAR:
-		(void)printf(fmtcheck(ofmt, "%*hhd"), v->width, *(char *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*hhd"), v->width, *(char *)bp);
 		break;
 	case UCHAR:
-		(void)printf(fmtcheck(ofmt, "%*hhu"), v->width, *(u_char *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*hhu"), v->width, *(u_char *)bp);
 		break;
 	case SHORT:
-		(void)printf(fmtcheck(ofmt, "%*hd"), v->width, *(short *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*hd"), v->width, *(short *)bp);
 		break;
 	case USHORT:
-		(void)printf(fmtcheck(ofmt, "%*hu"), v->width, *(u_short *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*hu"), v->width, *(u_short *)bp);
 		break;
 	case INT:
-		(void)printf(fmtcheck(ofmt, "%*d"), v->width, *(int *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*d"), v->width, *(int *)bp);
 		break;
 	case UINT:
-		(void)printf(fmtcheck(ofmt, "%*u"), v->width, *(u_int *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*u"), v->width, *(u_int *)bp);
 		break;
 	case LONG:
-		(void)printf(fmtcheck(ofmt, "%*ld"), v->width, *(long *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*ld"), v->width, *(long *)bp);
 		break;
 	case ULONG:
-		(void)printf(fmtcheck(ofmt, "%*lu"), v->width, *(u_long *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*lu"), v->width, *(u_long *)bp);
 		break;
 	case KPTR:
 #if FIXME
-		(void)printf(ofmt, v->width, *(u_long *)bp &~ KERNBASE);
+		(void)fprintf(psout, ofmt, v->width, *(u_long *)bp &~ KERNBASE);
 #else /* FIXME */
-		(void)printf(fmtcheck(ofmt, "%*lx"), v->width, *(u_long *)bp);
+		(void)fprintf(psout, fmtcheck(ofmt, "%*lx"), v->width, *(u_long *)bp);
 #endif /* FIXME */
 		break;
 	default:
@@ -1177,7 +1204,7 @@ uvar(k, ve)
 	if (k->ki_u.u_valid)
 		printval((char *)((char *)&k->ki_u + v->off), v);
 	else
-		(void)printf("%*s", v->width, "-");
+		(void)fprintf(psout, "%*s", v->width, "-");
 }
 
 void
@@ -1191,70 +1218,189 @@ rvar(k, ve)
 	if (k->ki_u.u_valid)
 		printval((char *)((char *)(&k->ki_u.u_ru) + v->off), v);
 	else
-		(void)printf("%*s", v->width, "-");
+		(void)fprintf(psout, "%*s", v->width, "-");
+}
+
+/*
+ * Compiled fields.  fmtcompile() turns the varlist into the fields[]
+ * array once the format is final, so that the per-row work is a walk
+ * over that array: pvar/evar/uvar/rvar columns print straight from a
+ * precomputed address with a precomputed format, without going through
+ * printval()'s type switch.
+ */
+#define	KPFIELD(name, type)						\
+static void								\
+name(KINFO *k, const FIELD *f)						\
+{									\
+	(void)fprintf(psout, f->ofmt, f->v->width,			\
+	    *(type *)((char *)k->ki_p + f->off));			\
+}
+
+#define	KUFIELD(name, type)						\
+static void								\
+name(KINFO *k, const FIELD *f)						\
+{									\
+	if (k->ki_u.u_valid)						\
+		(void)fprintf(psout, f->ofmt, f->v->width,		\
+		    *(type *)((char *)k + f->off));			\
+	else								\
+		(void)fprintf(psout, "%*s", f->v->width, "-");		\
+}
+
+KPFIELD(kp_char, char)
+KPFIELD(kp_uchar, u_char)
+KPFIELD(kp_short, short)
+KPFIELD(kp_ushort, u_short)
+KPFIELD(kp_int, int)
+KPFIELD(kp_uint, u_int)
+KPFIELD(kp_long, long)
+KPFIELD(kp_ulong, u_long)
+KUFIELD(ku_char, char)
+KUFIELD(ku_uchar, u_char)
+KUFIELD(ku_short, short)
+KUFIELD(ku_ushort, u_short)
+KUFIELD(ku_int, int)
+KUFIELD(ku_uint, u_int)
+KUFIELD(ku_long, long)
+KUFIELD(ku_ulong, u_long)
+
+static const struct {
+	const char *check;		/* for fmtcheck() */
+	void	(*kp)(KINFO *, const FIELD *);
+	void	(*ku)(KINFO *, const FIELD *);
+} fieldtypes[] = {
+	[CHAR] =	{ "%*hhd",	kp_char,	ku_char },
+	[UCHAR] =	{ "%*hhu",	kp_uchar,	ku_uchar },
+	[SHORT] =	{ "%*hd",	kp_short,	ku_short },
+	[USHORT] =	{ "%*hu",	kp_ushort,	ku_ushort },
+	[INT] =		{ "%*d",	kp_int,		ku_int },
+	[UINT] =	{ "%*u",	kp_uint,	ku_uint },
+	[LONG] =	{ "%*ld",	kp_long,	ku_long },
+	[ULONG] =	{ "%*lu",	kp_ulong,	ku_ulong },
+	[KPTR] =	{ "%*lx",	kp_ulong,	ku_ulong },
+};
+
+static void
+f_oproc(KINFO *k, const FIELD *f)
+{
+	(f->v->oproc)(k, f->ve);
 }
 
 void
-wq(KINFO *k, VARENT *ve)
+fmtcompile(void)
 {
+	struct varent *vent;
+	FIELD *f;
 	VAR *v;
-	struct proc_workqueueinfo wqinfo;
-	int len;
-	int ret;
-	uint32_t nthreads;
-
-	len = sizeof(wqinfo);
-	ret = proc_pidinfo(KI_PROC(k)->p_pid, PROC_PIDWORKQUEUEINFO, 0, &wqinfo, len);
+	const char *fcp;
+	char *cp;
+	int n;
 
-	v = ve->var;
+	n = 0;
+	STAILQ_FOREACH(vent, &varlist, next_ve)
+		n++;
+	free(fields);
+	if ((fields = calloc(n, sizeof(*fields))) == NULL)
+		errx(1, "malloc failed");
+	nfields = n;
 
-	if (len == ret && len == PROC_PIDWORKQUEUEINFO_SIZE) {
-		if (strcmp(v->name, "wql") == 0) {
-			char *s;
-			switch (wqinfo.pwq_state & (WQ_EXCEEDED_CONSTRAINED_THREAD_LIMIT | WQ_EXCEEDED_TOTAL_THREAD_LIMIT)) {
-			case 0:
-				s = "-";
-				break;
-			case WQ_EXCEEDED_CONSTRAINED_THREAD_LIMIT:
-				s = "C";
-				break;
-			case WQ_EXCEEDED_TOTAL_THREAD_LIMIT:
-				s = "T";
-				break;
-			default:
-				s = "CT";
-				break;
+	f = fields;
+	STAILQ_FOREACH(vent, &varlist, next_ve) {
+		v = vent->var;
+		f->ve = vent;
+		f->v = v;
+		f->print = f_oproc;
+		if ((v->oproc == pvar || v->oproc == evar ||
+		    v->oproc == uvar || v->oproc == rvar) &&
+		    (size_t)v->type < sizeof(fieldtypes) / sizeof(fieldtypes[0]) &&
+		    fieldtypes[v->type].kp != NULL &&
+		    strlen(v->fmt) + 3 < sizeof(f->fmtbuf)) {
+			cp = f->fmtbuf;
+			*cp++ = '%';
+			if (v->flag & LJUST)
+				*cp++ = '-';
+			*cp++ = '*';
+			for (fcp = v->fmt; (*cp++ = *fcp++); )
+				;
+			f->ofmt = fmtcheck(f->fmtbuf,
+			    fieldtypes[v->type].check);
+			if (v->oproc == pvar) {
+				f->off = offsetof(struct kinfo_proc, kp_proc) +
+				    v->off;
+				f->print = fieldtypes[v->type].kp;
+			} else if (v->oproc == evar) {
+				f->off = offsetof(struct kinfo_proc, kp_eproc) +
+				    v->off;
+				f->print = fieldtypes[v->type].kp;
+			} else if (v->oproc == uvar) {
+				f->off = offsetof(KINFO, ki_u) + v->off;
+				f->print = fieldtypes[v->type].ku;
+			} else {
+				f->off = offsetof(KINFO, ki_u.u_ru) + v->off;
+				f->print = fieldtypes[v->type].ku;
 			}
-			printf("%*s", v->width, s);
-			return;
 		}
-		if (strcmp(v->name, "wqr") == 0)
-			nthreads = wqinfo.pwq_runthreads;
-		else if (strcmp(v->name, "wqb") == 0)
-			nthreads = wqinfo.pwq_blockedthreads;
-		else
-			nthreads = wqinfo.pwq_nthreads;
-		printf("%*d", v->width, nthreads);
-	} else
-		printf("%*s", v->width, "-");
+		f++;
+	}
 }
 
-#ifdef __APPLE__
+/*
+ * Workqueue thread counts; which one is given by the keyword's offset.
+ */
 void
-persona(KINFO *k, VARENT *ve)
+wq(KINFO *k, VARENT *ve)
 {
+	const struct proc_workqueueinfo *wqinfo;
 	VAR *v;
-	struct kpersona_info info = { 0 };
-	int ret = 0;
 
-    v = ve->var;
+	v = ve->var;
+	if ((wqinfo = get_pidsrc(k, SRC_WQ)) != NULL)
+		fprintf(psout, "%*d", v->width,
+		    *(const uint32_t *)((const char *)wqinfo + v->off));
+	else
+		fprintf(psout, "%*s", v->width, "-");
+}
 
-	info.persona_info_version = PERSONA_INFO_V1;
-	ret = kpersona_pidinfo(KI_PROC(k)->p_pid, &info);
-	if (ret == 0) {
-		printf("%*u", v->width, info.persona_id);
-	} else {
-		printf("%*s", v->width, "-");
+void
+wql(KINFO *k, VARENT *ve)
+{
+	const struct proc_workqueueinfo *wqinfo;
+	VAR *v;
+	char *s;
+
+	v = ve->var;
+	if ((wqinfo = get_pidsrc(k, SRC_WQ)) == NULL) {
+		fprintf(psout, "%*s", v->width, "-");
+		return;
+	}
+	switch (wqinfo->pwq_state & (WQ_EXCEEDED_CONSTRAINED_THREAD_LIMIT | WQ_EXCEEDED_TOTAL_THREAD_LIMIT)) {
+	case 0:
+		s = "-";
+		break;
+	case WQ_EXCEEDED_CONSTRAINED_THREAD_LIMIT:
+		s = "C";
+		break;
+	case WQ_EXCEEDED_TOTAL_THREAD_LIMIT:
+		s = "T";
+		break;
+	default:
+		s = "CT";
+		break;
 	}
+	fprintf(psout, "%*s", v->width, s);
+}
+
+#ifdef __APPLE__
+void
+persona(KINFO *k, VARENT *ve)
+{
+	const uint32_t *id;
+	VAR *v;
+
+	v = ve->var;
+	if ((id = get_pidsrc(k, SRC_PERSONA)) != NULL)
+		fprintf(psout, "%*u", v->width, *id);
+	else
+		fprintf(psout, "%*s", v->width, "-");
 }
 #endif /* __APPLE__ */
@@ -0,0 +1,767 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Linux process source.
+ *
+ * Everything comes from /proc.  One getdents64(2) pass over the /proc
+ * directory enumerates the processes, and each per-process file is then
+ * opened with openat(2) relative to a single /proc descriptor and read
+ * into one reused buffer.  Only stat and status are needed to select a
+ * process; statm and cmdline are read later, and only for the processes
+ * ps keeps.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ps.h"
+
+#define	PROC_ROOT	"/proc"
+#define	PROCBUF_MIN	4096
+#define	DENTBUF_SIZE	32768
+#define	STATE_MAX	7
+
+/* Field numbers in /proc/<pid>/stat, as documented in proc(5). */
+#define	STAT_PPID	4
+#define	STAT_PGRP	5
+#define	STAT_SESSION	6
+#define	STAT_TTY_NR	7
+#define	STAT_TPGID	8
+#define	STAT_FLAGS	9
+#define	STAT_MINFLT	10
+#define	STAT_MAJFLT	12
+#define	STAT_UTIME	14
+#define	STAT_STIME	15
+#define	STAT_PRIORITY	18
+#define	STAT_NICE	19
+#define	STAT_NTHREADS	20
+#define	STAT_STARTTIME	22
+#define	STAT_POLICY	41
+#define	STAT_NFIELDS	41
+
+#define	PF_KTHREAD	0x00200000	/* kernel thread (linux/sched.h) */
+
+#define	SCHED_FIFO	1
+#define	SCHED_RR	2
+
+struct linux_dirent64 {
+	uint64_t	d_ino;
+	int64_t		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[];
+};
+
+static int	 procfd = -1;		/* descriptor for /proc */
+static __thread char *procbuf;	/* reused read buffer, per thread */
+static __thread size_t procbufsize;
+static __thread char *taskdbuf;		/* getdents64 buffer for task/ */
+static long	 clktck;		/* sysconf(_SC_CLK_TCK) */
+static long	 pagesize;
+static time_t	 boottime;		/* "btime" from /proc/stat */
+static unsigned long long uptime;	/* ticks since boot at snapshot */
+
+/*
+ * State letters, indexed by the values mach_state_order() returns; see
+ * tasks.c for the Mach version.
+ */
+			    /*01234567 */
+char	mach_state_table[] = " RUSITH?";
+
+int
+mach_state_order(int s, long sleep_time)
+{
+	switch (s) {
+	case TH_STATE_RUNNING:		return (1);
+	case TH_STATE_UNINTERRUPTIBLE:	return (2);
+	case TH_STATE_WAITING:		return ((sleep_time > 20) ? 4 : 3);
+	case TH_STATE_STOPPED:		return (5);
+	case TH_STATE_HALTED:		return (6);
+	default:			return (7);
+	}
+}
+
+/*
+ * Read a file below dirfd (/proc, or a directory under it) into procbuf
+ * and NUL-terminate it.  Returns the length read, or -1 if the file could
+ * not be read (typically because the process has exited since it was
+ * listed).
+ */
+static ssize_t
+procread(int dirfd, const char *path)
+{
+	ssize_t n, len;
+	size_t nsize;
+	char *nbuf;
+	int fd;
+
+	STATS_ADD(ST_SYSCALLS, 1);
+	if ((fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC)) == -1)
+		return (-1);
+	len = 0;
+	for (;;) {
+		if ((size_t)len + 1 >= procbufsize) {
+			/* Each thread starts out without a buffer. */
+			nsize = procbufsize != 0 ? procbufsize * 2 : PROCBUF_MIN;
+			if ((nbuf = realloc(procbuf, nsize)) == NULL)
+				errx(1, "malloc failed");
+			procbuf = nbuf;
+			procbufsize = nsize;
+		}
+		n = read(fd, procbuf + len, procbufsize - len - 1);
+		STATS_ADD(ST_SYSCALLS, 1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			(void)close(fd);
+			return (-1);
+		}
+		if (n == 0)
+			break;
+		len += n;
+	}
+	(void)close(fd);
+	STATS_ADD(ST_SYSCALLS, 1);
+	procbuf[len] = '\0';
+	return (len);
+}
+
+static ssize_t
+procread_pid(pid_t pid, const char *file)
+{
+	char path[32];
+
+	(void)snprintf(path, sizeof(path), "%d/%s", (int)pid, file);
+	return (procread(procfd, path));
+}
+
+static int
+procfs_init(void)
+{
+	char *cp;
+
+	if (procfd != -1)
+		goto snapshot;
+
+	procfd = open(PROC_ROOT, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (procfd == -1) {
+		warn("%s", PROC_ROOT);
+		return (-1);
+	}
+	clktck = sysconf(_SC_CLK_TCK);
+	pagesize = sysconf(_SC_PAGESIZE);
+
+	if (procread(procfd, "stat") == -1) {
+		warn("%s/stat", PROC_ROOT);
+		return (-1);
+	}
+	if ((cp = strstr(procbuf, "\nbtime ")) != NULL)
+		boottime = (time_t)strtoll(cp + 7, NULL, 10);
+
+snapshot:
+	/* Used to turn lifetime CPU ticks into a percentage. */
+	if (procread(procfd, "uptime") != -1)
+		uptime = (unsigned long long)(strtod(procbuf, NULL) * clktck);
+	return (0);
+}
+
+/*
+ * Parse /proc/<pid>/stat.  The command name is in parentheses and may
+ * itself contain spaces and parentheses, so the fixed fields are found
+ * from the last ')' rather than by splitting the whole line.
+ */
+static int
+parse_stat(struct kinfo_proc *kp, pid_t pid, char *buf)
+{
+	struct extern_proc *p;
+	struct eproc *e;
+	struct procstat *ps;
+	long long f[STAT_NFIELDS + 1];
+	char *lp, *rp, *cp;
+	size_t len;
+	int nf, tty;
+
+	p = &kp->kp_proc;
+	e = &kp->kp_eproc;
+	ps = &kp->kp_stat;
+
+	if ((lp = strchr(buf, '(')) == NULL ||
+	    (rp = strrchr(buf, ')')) == NULL || rp < lp || rp[1] != ' ')
+		return (-1);
+	len = rp - lp - 1;
+	if (len > MAXCOMLEN)
+		len = MAXCOMLEN;
+	memcpy(p->p_comm, lp + 1, len);
+	p->p_comm[len] = '\0';
+
+	cp = rp + 2;
+	ps->ps_state = *cp++;
+	memset(f, 0, sizeof(f));
+	for (nf = STAT_PPID; nf <= STAT_NFIELDS && *cp != '\0'; nf++)
+		f[nf] = strtoll(cp, &cp, 10);
+	if (nf <= STAT_STARTTIME)
+		return (-1);
+
+	p->p_pid = pid;
+	switch (ps->ps_state) {
+	case 'R':
+		p->p_stat = SRUN;
+		break;
+	case 'T':
+		p->p_stat = SSTOP;
+		break;
+	case 't':
+		p->p_stat = SSTOP;
+		p->p_flag |= P_TRACED;
+		break;
+	case 'Z':
+	case 'X':
+		p->p_stat = SZOMB;
+		break;
+	default:
+		p->p_stat = SSLEEP;
+		break;
+	}
+	if (f[STAT_FLAGS] & PF_KTHREAD)
+		p->p_flag |= P_SYSTEM;
+	p->p_nice = (char)f[STAT_NICE];
+	p->p_usrpri = (u_char)f[STAT_PRIORITY];
+	p->p_priority = (u_char)f[STAT_PRIORITY];
+
+	ps->ps_start = f[STAT_STARTTIME];
+	p->p_starttime.tv_sec = boottime + ps->ps_start / clktck;
+	p->p_starttime.tv_usec = (ps->ps_start % clktck) * 1000000 / clktck;
+
+	e->e_ppid = (pid_t)f[STAT_PPID];
+	e->e_pgid = (pid_t)f[STAT_PGRP];
+	e->e_sess = (u_long)f[STAT_SESSION];
+	e->e_tpgid = (pid_t)f[STAT_TPGID];
+	tty = (int)f[STAT_TTY_NR];
+	if (tty == 0)
+		e->e_tdev = NODEV;
+	else {
+		/* The kernel's new_encode_dev() layout. */
+		e->e_tdev = makedev((tty >> 8) & 0xfff,
+		    (tty & 0xff) | ((tty >> 12) & 0xfff00));
+		p->p_flag |= P_CONTROLT;
+		e->e_flag |= EPROC_CTTY;
+	}
+	if ((pid_t)f[STAT_SESSION] == pid)
+		e->e_flag |= EPROC_SLEADER;
+
+	ps->ps_minflt = (unsigned long)f[STAT_MINFLT];
+	ps->ps_majflt = (unsigned long)f[STAT_MAJFLT];
+	ps->ps_utime = f[STAT_UTIME];
+	ps->ps_stime = f[STAT_STIME];
+	ps->ps_priority = (int)f[STAT_PRIORITY];
+	ps->ps_nthreads = (long)f[STAT_NTHREADS];
+	ps->ps_policy = (int)f[STAT_POLICY];
+	return (0);
+}
+
+/*
+ * Parse the credentials, signal masks and context switch counts out of
+ * /proc/<pid>/status.
+ */
+static void
+parse_status(struct kinfo_proc *kp, char *buf)
+{
+	struct extern_proc *p;
+	struct eproc *e;
+	unsigned int r, ef, sv;
+	char *cp;
+
+	p = &kp->kp_proc;
+	e = &kp->kp_eproc;
+	for (cp = buf; cp != NULL && *cp != '\0'; cp = strchr(cp, '\n')) {
+		if (*cp == '\n')
+			cp++;
+		if (strncmp(cp, "Uid:", 4) == 0 &&
+		    sscanf(cp + 4, "%u %u %u", &r, &ef, &sv) == 3) {
+			e->e_pcred.p_ruid = r;
+			e->e_ucred.cr_uid = ef;
+			e->e_pcred.p_svuid = sv;
+		} else if (strncmp(cp, "Gid:", 4) == 0 &&
+		    sscanf(cp + 4, "%u %u %u", &r, &ef, &sv) == 3) {
+			e->e_pcred.p_rgid = r;
+			e->e_ucred.cr_gid = ef;
+			e->e_pcred.p_svgid = sv;
+		} else if (strncmp(cp, "SigPnd:", 7) == 0)
+			p->p_siglist = (int)strtoul(cp + 7, NULL, 16);
+		else if (strncmp(cp, "SigBlk:", 7) == 0)
+			p->p_sigmask = (uint32_t)strtoul(cp + 7, NULL, 16);
+		else if (strncmp(cp, "voluntary_ctxt_switches:", 24) == 0)
+			kp->kp_stat.ps_nvcsw = strtol(cp + 24, NULL, 10);
+		else if (strncmp(cp, "nonvoluntary_ctxt_switches:", 27) == 0)
+			kp->kp_stat.ps_nivcsw = strtol(cp + 27, NULL, 10);
+	}
+}
+
+/*
+ * Does this process match the sysctl(3)-style selector?  Selection by
+ * the credentials needs status as well as stat.
+ */
+static int
+procfs_match(const struct kinfo_proc *kp, int what, int flag)
+{
+
+	switch (what) {
+	case KERN_PROC_PGRP:
+		return (kp->kp_eproc.e_pgid == (pid_t)flag);
+	case KERN_PROC_SESSION:
+		return (kp->kp_eproc.e_sess == (u_long)flag);
+	case KERN_PROC_TTY:
+		return (kp->kp_eproc.e_tdev == (dev_t)flag);
+	case KERN_PROC_UID:
+		return (kp->kp_eproc.e_ucred.cr_uid == (uid_t)flag);
+	case KERN_PROC_RUID:
+		return (kp->kp_eproc.e_pcred.p_ruid == (uid_t)flag);
+	default:
+		return (1);
+	}
+}
+
+static int
+procfs_readproc(struct kinfo_proc *kp, pid_t pid, int what, int flag)
+{
+
+	memset(kp, 0, sizeof(*kp));
+	if (procread_pid(pid, "stat") == -1 ||
+	    parse_stat(kp, pid, procbuf) == -1)
+		return (0);
+	if (procread_pid(pid, "status") == -1)
+		return (0);
+	parse_status(kp, procbuf);
+	return (procfs_match(kp, what, flag));
+}
+
+static struct kinfo_proc *
+procfs_getprocs(int what, int flag, int *nentries)
+{
+	struct kinfo_proc *kp, *nkp;
+	struct linux_dirent64 *de;
+	char *dbuf, *ep;
+	long n, off;
+	int count, max;
+	pid_t pid;
+
+	if (procfs_init() == -1)
+		return (NULL);
+
+	count = 0;
+	max = 256;
+	if ((kp = malloc(max * sizeof(*kp))) == NULL)
+		errx(1, "malloc failed");
+
+	if (what == KERN_PROC_PID) {
+		if (procfs_readproc(&kp[0], (pid_t)flag, what, flag))
+			count = 1;
+		*nentries = count;
+		return (kp);
+	}
+
+	if ((dbuf = malloc(DENTBUF_SIZE)) == NULL)
+		errx(1, "malloc failed");
+	if (lseek(procfd, 0, SEEK_SET) == -1) {
+		warn("%s", PROC_ROOT);
+		free(dbuf);
+		free(kp);
+		return (NULL);
+	}
+	while ((n = syscall(SYS_getdents64, procfd, dbuf, DENTBUF_SIZE)) > 0) {
+		STATS_ADD(ST_SYSCALLS, 1);
+		for (off = 0; off < n; off += de->d_reclen) {
+			de = (struct linux_dirent64 *)(dbuf + off);
+			if (!isdigit((unsigned char)de->d_name[0]))
+				continue;
+			pid = (pid_t)strtol(de->d_name, &ep, 10);
+			if (*ep != '\0')
+				continue;
+			if (count == max) {
+				max *= 2;
+				nkp = realloc(kp, max * sizeof(*kp));
+				if (nkp == NULL)
+					errx(1, "malloc failed");
+				kp = nkp;
+			}
+			if (procfs_readproc(&kp[count], pid, what, flag))
+				count++;
+		}
+	}
+	if (n == -1) {
+		warn("%s", PROC_ROOT);
+		free(dbuf);
+		free(kp);
+		return (NULL);
+	}
+	free(dbuf);
+	*nentries = count;
+	return (kp);
+}
+
+static void
+ticks_to_time_value(unsigned long long ticks, time_value_t *tv)
+{
+
+	tv->seconds = (integer_t)(ticks / clktck);
+	tv->microseconds = (integer_t)((ticks % clktck) * 1000000 / clktck);
+}
+
+/*
+ * The Mach scheduling policy and priorities for a Linux one.
+ */
+static policy_t
+linux_policy(const struct procstat *ps, struct policy_timeshare_info *tshare,
+    struct policy_rr_info *rr, struct policy_fifo_info *fifo)
+{
+
+	switch (ps->ps_policy) {
+	case SCHED_FIFO:
+		fifo->base_priority = ps->ps_priority;
+		return (POLICY_FIFO);
+	case SCHED_RR:
+		rr->base_priority = ps->ps_priority;
+		return (POLICY_RR);
+	default:
+		tshare->base_priority = ps->ps_priority;
+		tshare->cur_priority = ps->ps_priority;
+		return (POLICY_TIMESHARE);
+	}
+}
+
+/*
+ * The Mach run state for a stat state letter.
+ */
+static int
+linux_run_state(const struct procstat *ps, int *sleep_time)
+{
+
+	*sleep_time = 0;
+	switch (ps->ps_state) {
+	case 'R':
+		return (TH_STATE_RUNNING);
+	case 'D':
+		return (TH_STATE_UNINTERRUPTIBLE);
+	case 'T':
+	case 't':
+		return (TH_STATE_STOPPED);
+	case 'Z':
+	case 'X':
+		return (TH_STATE_HALTED);
+	case 'I':
+		*sleep_time = 21;	/* idle, see mach_state_order() */
+		return (TH_STATE_WAITING);
+	default:
+		return (TH_STATE_WAITING);
+	}
+}
+
+/*
+ * There is no decayed usage figure in /proc, so use the CPU time over the
+ * life of the process or thread, the same as procps does.
+ */
+static int
+linux_cpu_usage(const struct procstat *ps)
+{
+	unsigned long long life;
+
+	life = uptime > ps->ps_start ? uptime - ps->ps_start : 0;
+	if (life == 0)
+		return (0);
+	return ((int)((ps->ps_utime + ps->ps_stime) * TH_USAGE_SCALE / life));
+}
+
+/*
+ * One thread_values for each entry of /proc/<pid>/task.  The directory
+ * is opened once and each thread's stat is read relative to it, so there
+ * is no path lookup from /proc down per thread, and the directory and
+ * file buffers are the per-thread ones used for everything else.
+ */
+static void
+procfs_threads(KINFO *ki)
+{
+	struct kinfo_proc tkp;
+	struct linux_dirent64 *de;
+	thread_values_t *tv, *ntv;
+	struct procstat *ps;
+	char path[32], *ep;
+	unsigned int max;
+	long n, off;
+	int taskfd, sleep_time;
+	pid_t tid;
+
+	ki->thread_count = 0;
+	ki->invalid_thinfo = 1;
+	(void)snprintf(path, sizeof(path), "%d/task", (int)KI_PROC(ki)->p_pid);
+	STATS_ADD(ST_SYSCALLS, 1);
+	taskfd = openat(procfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (taskfd == -1)
+		return;
+	if (taskdbuf == NULL && (taskdbuf = malloc(DENTBUF_SIZE)) == NULL)
+		errx(1, "malloc failed");
+
+	/* Threads may come and go while we look; grow as needed. */
+	max = ki->ki_p->kp_stat.ps_nthreads > 0 ?
+	    (unsigned int)ki->ki_p->kp_stat.ps_nthreads : 1;
+	ki->thval = acalloc(max, sizeof(*ki->thval));
+	while ((n = syscall(SYS_getdents64, taskfd, taskdbuf,
+	    DENTBUF_SIZE)) > 0) {
+		STATS_ADD(ST_SYSCALLS, 1);
+		for (off = 0; off < n; off += de->d_reclen) {
+			de = (struct linux_dirent64 *)(taskdbuf + off);
+			if (!isdigit((unsigned char)de->d_name[0]))
+				continue;
+			tid = (pid_t)strtol(de->d_name, &ep, 10);
+			if (*ep != '\0')
+				continue;
+			(void)snprintf(path, sizeof(path), "%s/stat",
+			    de->d_name);
+			memset(&tkp, 0, sizeof(tkp));
+			if (procread(taskfd, path) == -1 ||
+			    parse_stat(&tkp, tid, procbuf) == -1)
+				continue;	/* gone already */
+			if (ki->thread_count == max) {
+				ntv = acalloc(max * 2, sizeof(*ntv));
+				memcpy(ntv, ki->thval, max * sizeof(*ntv));
+				ki->thval = ntv;
+				max *= 2;
+			}
+			tv = &ki->thval[ki->thread_count++];
+			ps = &tkp.kp_stat;
+			ticks_to_time_value(ps->ps_utime, &tv->tb.user_time);
+			ticks_to_time_value(ps->ps_stime,
+			    &tv->tb.system_time);
+			tv->tb.cpu_usage = linux_cpu_usage(ps);
+			tv->tb.policy = linux_policy(ps,
+			    &tv->schedinfo.tshare, &tv->schedinfo.rr,
+			    &tv->schedinfo.fifo);
+			tv->tb.run_state = linux_run_state(ps, &sleep_time);
+			tv->tb.sleep_time = sleep_time;
+		}
+	}
+	ki->invalid_thinfo = n == -1;
+	(void)close(taskfd);
+	STATS_ADD(ST_SYSCALLS, 1);
+}
+
+static int
+procfs_taskinfo(KINFO *ki, int what)
+{
+	struct procstat *ps;
+	unsigned long long size, resident;
+	int run_state, sleep_time;
+
+	if (what & COLLECT_THREADS)
+		procfs_threads(ki);
+	if ((what & COLLECT_TASK) == 0)
+		return (0);
+
+	ps = &ki->ki_p->kp_stat;
+	ki->state = STATE_MAX;
+
+	if (procread_pid(KI_PROC(ki)->p_pid, "statm") == -1 ||
+	    sscanf(procbuf, "%llu %llu", &size, &resident) != 2) {
+		ki->invalid_tinfo = 1;
+		return (1);
+	}
+	ki->tasks_info.virtual_size = size * pagesize;
+	ki->tasks_info.resident_size = resident * pagesize;
+	ticks_to_time_value(ps->ps_utime, &ki->tasks_info.user_time);
+	ticks_to_time_value(ps->ps_stime, &ki->tasks_info.system_time);
+	/* Linux reports one total for all threads, live or dead. */
+	memset(&ki->times, 0, sizeof(ki->times));
+
+	ki->tasks_info.policy = linux_policy(ps, &ki->schedinfo.tshare,
+	    &ki->schedinfo.rr, &ki->schedinfo.fifo);
+	ki->curpri = ki->basepri = ps->ps_priority;
+	ki->invalid_tinfo = 0;
+	ki->cpu_usage = linux_cpu_usage(ps);
+
+	/*
+	 * The process's own state is the one stat reports, rather than
+	 * the most active of its threads as on Mach.
+	 */
+	run_state = linux_run_state(ps, &sleep_time);
+	ki->state = mach_state_order(run_state, sleep_time);
+	ki->swapped = 0;
+	return (0);
+}
+
+/*
+ * Build a KERN_PROCARGS2-style argument area out of cmdline (and environ,
+ * when -e asked for it): argc, an empty exec path, then the strings.
+ */
+static char *
+procfs_procargs(KINFO *ki, size_t *sizep)
+{
+	extern int eflg;
+	ssize_t alen, elen;
+	char *procargs;
+	int argc;
+	pid_t pid;
+
+	pid = KI_PROC(ki)->p_pid;
+	if ((alen = procread_pid(pid, "cmdline")) <= 0)
+		return (NULL);
+	/* setproctitle() may leave the last string unterminated. */
+	if (procbuf[alen - 1] != '\0')
+		alen++;
+	for (argc = 0, elen = 0; elen < alen; elen++)
+		if (procbuf[elen] == '\0')
+			argc++;
+
+	procargs = amalloc(sizeof(argc) + 1 + alen);
+	memcpy(procargs, &argc, sizeof(argc));
+	procargs[sizeof(argc)] = '\0';
+	memcpy(procargs + sizeof(argc) + 1, procbuf, alen);
+	*sizep = sizeof(argc) + 1 + alen;
+
+	if (eflg && (elen = procread_pid(pid, "environ")) > 0) {
+		char *np;
+
+		/* procbuf now holds the environment; append it to a copy. */
+		np = amalloc(*sizep + elen + 1);
+		memcpy(np, procargs, *sizep);
+		procargs = np;
+		memcpy(procargs + *sizep, procbuf, elen);
+		procargs[*sizep + elen] = '\0';
+		*sizep += elen + 1;
+	}
+	return (procargs);
+}
+
+/*
+ * Only io is worth a source of its own; everything else the columns use
+ * comes with stat and status.  io is readable only by the process's owner
+ * (strictly, whoever may ptrace it), so it is often unavailable.
+ */
+static int
+procfs_pidinfo(KINFO *ki, int src, void *buf)
+{
+	struct pidio *pio;
+	char *cp;
+
+	if (src != SRC_IO || procread_pid(KI_PROC(ki)->p_pid, "io") == -1)
+		return (-1);
+	pio = buf;
+	if ((cp = strstr(procbuf, "\nread_bytes:")) != NULL)
+		pio->pio_rbytes = strtoull(cp + 12, NULL, 10);
+	if ((cp = strstr(procbuf, "\nwrite_bytes:")) != NULL)
+		pio->pio_wbytes = strtoull(cp + 13, NULL, 10);
+	return (0);
+}
+
+/*
+ * Is /dev/<name> the device dev, of the given type?
+ */
+static int
+devmatch(const char *name, dev_t dev, mode_t type)
+{
+	struct stat sb;
+	char path[sizeof("/dev/") + PATH_MAX];
+
+	(void)snprintf(path, sizeof(path), "/dev/%s", name);
+	return (stat(path, &sb) == 0 && (sb.st_mode & S_IFMT) == type &&
+	    sb.st_rdev == dev);
+}
+
+/*
+ * Look through the directory /dev/<dir> for dev; the name found is left
+ * in name.
+ */
+static int
+devsearch(const char *dir, dev_t dev, mode_t type, char *name, size_t size)
+{
+	struct dirent *de;
+	char path[PATH_MAX];
+	DIR *dp;
+	int found;
+
+	(void)snprintf(path, sizeof(path), "/dev/%s", dir);
+	if ((dp = opendir(path)) == NULL)
+		return (0);
+	found = 0;
+	while (!found && (de = readdir(dp)) != NULL) {
+		if (de->d_name[0] == '.' ||
+		    (de->d_type != DT_CHR && de->d_type != DT_UNKNOWN))
+			continue;
+		(void)snprintf(name, size, "%s%s", dir, de->d_name);
+		found = devmatch(name, dev, type);
+	}
+	(void)closedir(dp);
+	return (found);
+}
+
+/*
+ * devname(3), which glibc and libbsd lack: the name of a device relative
+ * to /dev, in a static buffer, or NULL if there is none.  The kernel's
+ * usual names for the pty, virtual console and serial majors are tried
+ * first (devices.txt), then /dev/pts and /dev are searched.
+ */
+char *
+devname(dev_t dev, mode_t type)
+{
+	static char name[PATH_MAX];
+	unsigned int maj, min;
+
+	maj = major(dev);
+	min = minor(dev);
+	name[0] = '\0';
+	if (maj >= 136 && maj <= 143)
+		(void)snprintf(name, sizeof(name), "pts/%u",
+		    (maj - 136) * 256 + min);
+	else if (maj == 4 && min < 64)
+		(void)snprintf(name, sizeof(name), "tty%u", min);
+	else if (maj == 4)
+		(void)snprintf(name, sizeof(name), "ttyS%u", min - 64);
+	else if (maj == 5 && min == 1)
+		(void)strlcpy(name, "console", sizeof(name));
+	if (name[0] != '\0' && devmatch(name, dev, type))
+		return (name);
+	if (devsearch("pts/", dev, type, name, sizeof(name)) ||
+	    devsearch("", dev, type, name, sizeof(name)))
+		return (name);
+	return (NULL);
+}
+
+const PROCSOURCE procfs_source = {
+	"procfs",
+	procfs_getprocs,
+	procfs_taskinfo,
+	procfs_procargs,
+	procfs_pidinfo,
+};
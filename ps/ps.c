@@ -50,35 +50,41 @@ static char sccsid[] = "@(#)ps.c	8.4 (Berkeley) 4/2/94";
 __FBSDID("$FreeBSD: src/bin/ps/ps.c,v 1.110 2005/02/09 17:37:38 ru Exp $");
 
 #include <sys/param.h>
-#ifdef __APPLE__
+#if defined(__APPLE__) || defined(__linux__)
 #include <sys/time.h>
-#endif /* __APPLE__ */
+#endif /* __APPLE__ || __linux__ */
+#ifndef __linux__
 #include <sys/proc.h>
 #include <sys/user.h>
+#endif /* !__linux__ */
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#ifndef __linux__
 #include <sys/sysctl.h>
 #include <sys/mount.h>
 #include <sys/resourcevar.h>
+#endif /* !__linux__ */
 
 #ifdef __APPLE__
-#include <assert.h>
 #endif
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <grp.h>
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 #include <kvm.h>
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 #include <limits.h>
 #include <locale.h>
 #include <paths.h>
 #include <pwd.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "ps.h"
@@ -115,18 +121,33 @@ int	 termwidth;		/* Width of the screen (0 == infinity). */
 int	 totwidth;		/* Calculated-width of requested variables. */
 
 struct velisthead varlist = STAILQ_HEAD_INITIALIZER(varlist);
+const PROCSOURCE *procsrc;	/* Where the process table comes from. */
+FILE	*psout;			/* Where the output routines write. */
 
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 static int	 forceuread = DEF_UREAD; /* Do extra work to get u-area. */
 static kvm_t	*kd;
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 static KINFO	*kinfo;
 static int	 needcomm;	/* -o "command" */
+static int	 needdata;	/* COLLECT_* for the columns */
+#ifdef __linux__
+static int	 needio;	/* -o inblk,oublk: SRC_IO */
+#endif
 static int	 needenv;	/* -e */
 static int	 needuser;	/* -o "user" */
+static int	 njobs;		/* -J: collection threads */
+static double	 watchint;	/* -W: seconds between snapshots */
+static ARENA	 snaparena[2];	/* per-snapshot data; see watch.c */
 static int	 optfatal;	/* Fatal error parsing some list-option. */
 
-static enum sort { DEFAULT, SORTMEM, SORTCPU } sortby = DEFAULT;
+static enum sort { DEFAULT, SORTMEM, SORTCPU, SORTLIST } sortby = DEFAULT;
+static const char *sortlist;	/* --sort */
+static int	 topn;		/* --top: rows wanted, 0 for all */
+static const char *savefile;	/* --save */
+static int	 streamflg;	/* --stream */
+static int	 forest;	/* --forest */
+static int	 statsflg;	/* --stats */
 
 struct listinfo;
 typedef	int	addelem_rtn(struct listinfo *_inf, const char *_elem);
@@ -144,30 +165,39 @@ struct listinfo {
 		uid_t	*uids;
 		void	*ptr;
 	} l;
+	uint64_t	*hash;		/* open-addressing set of l, or NULL */
+	int		 hashshift;	/* 64 - log2(slots) */
+	int		 hashfull;	/* HASH_EMPTY itself is in l */
 };
 
-#ifndef __APPLE__
+#define	HASH_EMPTY	UINT64_MAX	/* unused hash slot */
+
+#if !defined(__APPLE__) && !defined(__linux__)
 static int	 check_procfs(void);
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 static int	 addelem_gid(struct listinfo *, const char *);
 static int	 addelem_pid(struct listinfo *, const char *);
 static int	 addelem_tty(struct listinfo *, const char *);
 static int	 addelem_uid(struct listinfo *, const char *);
 static void	 add_list(struct listinfo *, const char *);
 static void	 dynsizevars(KINFO *);
+static void	 fixvars(void);
 static void	*expand_list(struct listinfo *);
-#ifndef __APPLE__
+static void	 hash_list(struct listinfo *);
+static int	 in_list(const struct listinfo *, const void *);
+#if !defined(__APPLE__) && !defined(__linux__)
 static const char *
 		 fmt(char **(*)(kvm_t *, const struct kinfo_proc *, int),
 		    KINFO *, char *, int);
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 static void	 free_list(struct listinfo *);
 static void	 init_list(struct listinfo *, addelem_rtn, int, const char *);
 static char	*kludge_oldps_options(const char *, char *, const char *, int *);
-static int	 pscomp(const void *, const void *);
+static void	 printproc(KINFO *, int, int *);
 static void	 saveuser(KINFO *);
 static void	 scanvars(void);
 static void	 sizevars(void);
+static void	 streamproc(KINFO *, int, int, int *);
 static void	 usage(int);
 
 /* 5842004: Fix -f option. */
@@ -197,8 +227,32 @@ int mflg = 0; /* if -M option to display all mach threads */
 int print_thread_num = 0;
 int print_all_thread = 0;
 
-#define	PS_ARGS	(u03 ? "aACcdeEfg:G:hjLlMmO:o:p:rSTt:U:u:vwx" : \
-	"aACcdeEgG:hjLlMmO:o:p:rSTt:U:uvwx")
+/* Long options; their values are outside the range of option letters. */
+enum {
+	OPT_FORMAT = CHAR_MAX + 1,
+	OPT_FOREST,
+	OPT_SORT,
+	OPT_TOP,
+	OPT_SAVE,
+	OPT_LOAD,
+	OPT_STATS,
+	OPT_STREAM,
+};
+
+static const struct option longopts[] = {
+	{ "forest",	no_argument,		NULL,	OPT_FOREST },
+	{ "format",	required_argument,	NULL,	OPT_FORMAT },
+	{ "sort",	required_argument,	NULL,	OPT_SORT },
+	{ "top",	required_argument,	NULL,	OPT_TOP },
+	{ "save",	required_argument,	NULL,	OPT_SAVE },
+	{ "load",	required_argument,	NULL,	OPT_LOAD },
+	{ "stats",	no_argument,		NULL,	OPT_STATS },
+	{ "stream",	no_argument,		NULL,	OPT_STREAM },
+	{ NULL,		0,			NULL,	0 }
+};
+
+#define	PS_ARGS	(u03 ? "aACcdeEfg:G:hJ:jLlMmO:o:p:rSTt:U:u:vW:wx" : \
+	"aACcdeEgG:hJ:jLlMmO:o:p:rSTt:U:uvW:wx")
 
 int
 main(int argc, char *argv[])
@@ -206,33 +260,25 @@ main(int argc, char *argv[])
 	struct listinfo gidlist, pgrplist, pidlist;
 	struct listinfo ruidlist, sesslist, ttylist, uidlist;
 	struct kinfo_proc *kp;
-	KINFO *next_KINFO;
-	struct varent *vent;
+	KINFO *next_KINFO, **sorted;
 	struct winsize ws;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 	const char *nlistf, *memf;
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 	char *cols;
-	int all, ch, elem, flag, _fmt, i, lineno;
-	int nentries, nkept, nselectors;
+	int all, ch, collect, flag, _fmt, i, lineno, sortopt;
+	int n, nentries, nkept, nkinfo, nselectors, nshow, nsnap;
 	int prtheader, showthreads, wflag, what, xkeep, xkeep_implied;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 	char errbuf[_POSIX2_LINE_MAX];
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 	struct kinfo_proc *kprocbuf;
-	int j;
-	int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_ALL, 0 };
-	size_t bufSize = 0;
-	size_t orig_bufSize = 0;
-	int local_error=0;
-	int retry_count = 0;
 	int u03 = COMPAT_MODE("bin/ps", "unix2003");
 #ifdef __APPLE__
 	int dflag = 0;
 #endif /* __APPLE__ */
 
 	(void) setlocale(LC_ALL, "");
-	time(&now);			/* Used by routines in print.c. */
 
 	if ((cols = getenv("COLUMNS")) != NULL && *cols != '\0')
 		termwidth = atoi(cols);
@@ -251,7 +297,7 @@ main(int argc, char *argv[])
 	if (argc > 1)
 		argv[1] = kludge_oldps_options(PS_ARGS, argv[1], argv[2], &u03);
 
-	all = _fmt = nselectors = optfatal = 0;
+	all = _fmt = nselectors = optfatal = sortopt = 0;
 	prtheader = showthreads = wflag = xkeep_implied = 0;
 	xkeep = -1;			/* Neither -x nor -X. */
 	init_list(&gidlist, addelem_gid, sizeof(gid_t), "group");
@@ -261,11 +307,23 @@ main(int argc, char *argv[])
 	init_list(&sesslist, addelem_pid, sizeof(pid_t), "session id");
 	init_list(&ttylist, addelem_tty, sizeof(dev_t), "tty");
 	init_list(&uidlist, addelem_uid, sizeof(uid_t), "user");
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 	memf = nlistf = _PATH_DEVNULL;
-#endif /* !__APPLE__ */
-	while ((ch = getopt(argc, argv, PS_ARGS)) != -1)
-		switch ((char)ch) {
+#endif /* !__APPLE__ && !__linux__ */
+#if defined(__APPLE__)
+	procsrc = &sysctl_source;
+#elif defined(__linux__)
+	procsrc = &procfs_source;
+#endif
+#ifdef PS_FIXTURES
+	if (getenv("PS_FIXTURE") != NULL)
+		procsrc = &fixture_source;
+#endif
+	if ((njobs = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		njobs = 1;
+	psout = stdout;
+	while ((ch = getopt_long(argc, argv, PS_ARGS, longopts, NULL)) != -1)
+		switch (ch) {
 #ifdef __APPLE__
 		case 'd':
 			dflag = 1;
@@ -336,14 +394,26 @@ main(int argc, char *argv[])
 			xkeep_implied = 1;
 			nselectors++;
 			break;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 		case 'H':
 			showthreads = KERN_PROC_INC_THREAD;
 			break;
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 		case 'h':
 			prtheader = ws.ws_row > 5 ? ws.ws_row : 22;
 			break;
+		case 'J': {
+			char *ep;
+			long l;
+
+			errno = 0;
+			l = strtol(optarg, &ep, 10);
+			if (*optarg == '\0' || *ep != '\0' || errno != 0 ||
+			    l < 1 || l > 1024)
+				errx(1, "invalid number of jobs: %s", optarg);
+			njobs = (int)l;
+			break;
+		}
 		case 'j':
 			parsefmt(jfmt, 0);
 			_fmt = 1;
@@ -359,14 +429,14 @@ main(int argc, char *argv[])
 			break;
 		case 'M':
 #if !PS_ENTITLEMENT_ENFORCED
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 			memf = optarg;
 #else
 			parsefmt(mfmt, 0);
 			_fmt = 1;
 			mfmt[0] = '\0';
 			mflg  = 1;
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 #else /* PS_ENTITLEMENT_ENFORCED */
 			errx(1, "-M requires entitlement");
 #endif /* !PS_ENTITLEMENT_ENFORCED */
@@ -374,15 +444,16 @@ main(int argc, char *argv[])
 		case 'm':
 #if !PS_ENTITLEMENT_ENFORCED
 			sortby = SORTMEM;
+			sortopt = 1;
 #else
 			errx(1, "-m requires entitlement");
 #endif /* !PS_ENTITLEMENT_ENFORCED */
 			break;
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 		case 'N':
 			nlistf = optarg;
 			break;
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 		case 'O':
 			parsefmt(o1, 1);
 			parsefmt(optarg, 1);
@@ -406,6 +477,7 @@ main(int argc, char *argv[])
 			break;
 		case 'r':
 			sortby = SORTCPU;
+			sortopt = 1;
 			break;
 		case 'S':
 			sumrusage = 1;
@@ -450,6 +522,51 @@ main(int argc, char *argv[])
 			_fmt = 1;
 			vfmt[0] = '\0';
 			break;
+		case OPT_FORMAT:
+			if ((outstyle = outfmt_parse(optarg)) == -1)
+				errx(1, "unknown format: %s", optarg);
+			break;
+		case OPT_FOREST:
+			forest = 1;
+			break;
+		case OPT_SORT:
+			sortby = SORTLIST;
+			sortlist = optarg;
+			break;
+		case OPT_TOP: {
+			char *ep;
+			long l;
+
+			errno = 0;
+			l = strtol(optarg, &ep, 10);
+			if (*optarg == '\0' || *ep != '\0' || errno != 0 ||
+			    l < 1 || l > INT_MAX)
+				errx(1, "invalid number of rows: %s", optarg);
+			topn = (int)l;
+			break;
+		}
+		case OPT_SAVE:
+			savefile = optarg;
+			break;
+		case OPT_LOAD:
+			snap_open(optarg);
+			break;
+		case OPT_STATS:
+			statsflg = 1;
+			break;
+		case OPT_STREAM:
+			streamflg = 1;
+			break;
+		case 'W': {
+			char *ep;
+
+			errno = 0;
+			watchint = strtod(optarg, &ep);
+			if (*optarg == '\0' || *ep != '\0' || errno != 0 ||
+			    !(watchint > 0))
+				errx(1, "invalid interval: %s", optarg);
+			break;
+		}
 		case 'w':
 			if (wflag)
 				termwidth = UNLIMITED;
@@ -480,6 +597,7 @@ main(int argc, char *argv[])
 		}
 	argc -= optind;
 	argv += optind;
+	stats_init(statsflg);
 
 #ifdef __APPLE__
 	/* 3862041 */
@@ -493,10 +611,10 @@ main(int argc, char *argv[])
 	 * Check to make sure that procfs is mounted on /proc, otherwise
 	 * print a warning informing the user that output will be incomplete.
 	 */
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 	if (needenv == 1 && check_procfs() == 0)
 		warnx("Process environment requires procfs(5)");
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 	/*
 	 * If there arguments after processing all the options, attempt
 	 * to treat them as a list of process ids.
@@ -514,6 +632,12 @@ main(int argc, char *argv[])
 	}
 	if (optfatal)
 		exit(1);		/* Error messages already printed. */
+	if (savefile != NULL && watchint > 0)
+		errx(1, "--save cannot be used with -W");
+	if (streamflg && (watchint > 0 || savefile != NULL || sortopt ||
+	    sortby == SORTLIST || topn > 0 || forest))
+		errx(1, "--stream cannot be used with -W, -m, -r, --save, "
+		    "--sort, --top or --forest");
 	if (xkeep < 0)			/* Neither -X nor -x was specified. */
 		xkeep = xkeep_implied;
 
@@ -530,6 +654,22 @@ main(int argc, char *argv[])
 		parsefmt(u03 ? p_dfmt : dfmt, 0);
 	}
 
+	switch (sortby) {
+	case SORTCPU:
+		sort_parse("-%cpu");
+		break;
+	case SORTMEM:
+		/* Not reachable in the unentitled build; see -m and -v. */
+		sort_parse("-rss");
+		break;
+	case SORTLIST:
+		sort_parse(sortlist);
+		break;
+	default:
+		sort_parse("tt");
+		break;
+	}
+
 	if (nselectors == 0) {
 		uidlist.l.ptr = malloc(sizeof(uid_t));
 		if (uidlist.l.ptr == NULL)
@@ -538,12 +678,52 @@ main(int argc, char *argv[])
 		uidlist.count = uidlist.maxcount = 1;
 		*uidlist.l.uids = getuid();
 	}
+	hash_list(&gidlist);
+	hash_list(&pgrplist);
+	hash_list(&pidlist);
+	hash_list(&ruidlist);
+	hash_list(&sesslist);
+	hash_list(&ttylist);
+	hash_list(&uidlist);
 
 	/*
 	 * scan requested variables, noting what structures are needed,
 	 * and adjusting header widths as appropriate.
 	 */
 	scanvars();
+	fmtcompile();
+	if (outstyle != OUT_TEXT) {
+		outfmt_init();
+		prtheader = 0;
+	}
+	if (streamflg) {
+		/* Rows go out one at a time, so don't hold them back. */
+		if (outstyle == OUT_TEXT)
+			fixvars();
+		(void)setvbuf(stdout, NULL, _IOLBF, 0);
+	}
+
+	/*
+	 * Only gather per-process data that the columns or the sort order
+	 * use.  -M prints a row per thread, and watch mode works %cpu out
+	 * from the task times.
+	 */
+	collect = needdata | sort_needs();
+#ifdef __linux__
+	/*
+	 * /proc/<pid>/stat already has the state, usage and priority that
+	 * %cpu, pri and state show for a process; reading every thread's
+	 * stat is only worth it for -M's per-thread rows.
+	 */
+	if (procsrc == &procfs_source)
+		collect &= ~COLLECT_THREADS;
+#endif
+	if (mflg)
+		collect |= COLLECT_TASK | COLLECT_THREADS;
+	if (watchint > 0)
+		collect |= COLLECT_TASK;
+	if (savefile != NULL)
+		collect |= COLLECT_TASK | COLLECT_THREADS | COLLECT_ARGS;
 
 	/*
 	 * Get process list.  If the user requested just one selector-
@@ -589,68 +769,45 @@ main(int argc, char *argv[])
 	}
 
 	/*
-	 * select procs
+	 * select procs; in watch mode, everything from here on is repeated
+	 * for every snapshot.
+	 */
+	nkinfo = 0;
+	nsnap = 0;
+snapshot:
+	/*
+	 * Everything collected for a snapshot comes from its arena.  Watch
+	 * mode alternates between two so that the previous snapshot is still
+	 * intact while the next one is taken.
 	 */
+	curarena = &snaparena[nsnap++ % 2];
+	arena_reset(curarena);
+	time(&now);			/* Used by routines in print.c. */
 	nentries = -1;
+	stats_phase(ST_FETCH);
 #if FIXME
 	kp = kvm_getprocs(kd, what, flag, &nentries);
 	if ((kp == NULL && nentries > 0) || (kp != NULL && nentries < 0))
 		errx(1, "%s", kvm_geterr(kd));
 #else /* FIXME */
-    mib[0] = CTL_KERN;
-    mib[1] = KERN_PROC;
-    mib[2] = what;
-    mib[3] = flag;
-
-    if (sysctl(mib, 4, NULL, &bufSize, NULL, 0) < 0) {
-        perror("Failure calling sysctl");
-        return 0;
-    }
-
-    kprocbuf= kp = (struct kinfo_proc *)malloc(bufSize);
-
-    retry_count = 0;
-    orig_bufSize = bufSize;
-   for(retry_count=0; ; retry_count++) {
-    /* retry for transient errors due to load in the system */
-    local_error = 0;
-    bufSize = orig_bufSize;
-    if ((local_error = sysctl(mib, 4, kp, &bufSize, NULL, 0)) < 0) {
-        if (retry_count < 1000) {
-            /*
-             * The space required may have grown since the initial check and
-             * there is no guarantee it will drop back down even after 1000
-             * iterations, so realloc the buffer before trying again.
-             */
-            if (errno == ENOMEM) {
-                if (sysctl(mib, 4, NULL, &bufSize, NULL, 0) == 0) {
-                    kprocbuf = kp = (struct kinfo_proc *)realloc(kp, bufSize);
-                    orig_bufSize = bufSize;
-                    continue;
-                }
-            }
-
-            /* 1 sec back off */
-            sleep(1);
-            continue;
-        }
-        perror("Failure calling sysctl");
-        return 0;
-    } else if (local_error == 0) {
-	break;
-    }
-    /* 1 sec back off */
-    sleep(1);
-   }
-
-    /* This has to be after the second sysctl since the bufSize
-       may have changed.  */
-    nentries = bufSize / sizeof(struct kinfo_proc);
+	kprocbuf = kp = (*procsrc->getprocs)(what, flag, &nentries);
+	if (kp == NULL)
+		return 0;
 #endif /* FIXME */
-	nkept = 0;
+	stats_phase(ST_SELECT);
+	nkept = lineno = 0;
+	if (streamflg)
+		printheader();
 	if (nentries > 0) {
-		if ((kinfo = calloc(nentries, sizeof(*kinfo))) == NULL)
-			errx(1, "malloc failed");
+		/* --stream reuses one KINFO for each process in turn. */
+		n = streamflg ? 1 : nentries;
+		if (n > nkinfo) {
+			free(kinfo);
+			if ((kinfo = malloc(n * sizeof(*kinfo))) == NULL)
+				errx(1, "malloc failed");
+			nkinfo = n;
+		}
+		memset(kinfo, 0, n * sizeof(*kinfo));
 		for (i = nentries; --i >= 0; ++kp) {
 #ifdef __APPLE__
 			if (kp->kp_proc.p_pid == 0) {
@@ -668,11 +825,8 @@ main(int argc, char *argv[])
 			 * then keep any process matched by the inclusive OR
 			 * of all the selection-criteria given.
 			 */
-			if (pidlist.count > 0) {
-				for (elem = 0; elem < pidlist.count; elem++)
-					if (kp->kp_proc.p_pid == pidlist.l.pids[elem])
-						goto keepit;
-			}
+			if (in_list(&pidlist, &kp->kp_proc.p_pid))
+				goto keepit;
 			/*
 			 * Note that we had to process pidlist before
 			 * filtering out processes which do not have
@@ -684,47 +838,26 @@ main(int argc, char *argv[])
 					continue;
 #ifdef __APPLE__
 				/* rdar://problem/86332769 */
-				if (devname(kp->kp_eproc.e_tdev, S_IFCHR) ==
-				    NULL)
+				if (nc_tty(kp->kp_eproc.e_tdev) == NULL)
 					continue;
 #endif
 			}
 			if (all || nselectors == 0)
 				goto keepit;
-			if (gidlist.count > 0) {
-				for (elem = 0; elem < gidlist.count; elem++)
-					if (kp->kp_eproc.e_pcred.p_rgid == gidlist.l.gids[elem])
-						goto keepit;
-			}
-			if (pgrplist.count > 0) {
-				for (elem = 0; elem < pgrplist.count; elem++)
-					if (kp->kp_eproc.e_pgid ==
-					    pgrplist.l.pids[elem])
-						goto keepit;
-			}
-			if (ruidlist.count > 0) {
-				for (elem = 0; elem < ruidlist.count; elem++)
-					if (kp->kp_eproc.e_pcred.p_ruid ==
-					    ruidlist.l.uids[elem])
-						goto keepit;
-			}
+			if (in_list(&gidlist, &kp->kp_eproc.e_pcred.p_rgid))
+				goto keepit;
+			if (in_list(&pgrplist, &kp->kp_eproc.e_pgid))
+				goto keepit;
+			if (in_list(&ruidlist, &kp->kp_eproc.e_pcred.p_ruid))
+				goto keepit;
 #if 0
-			if (sesslist.count > 0) {
-				for (elem = 0; elem < sesslist.count; elem++)
-					if (kp->ki_sid == sesslist.l.pids[elem])
-						goto keepit;
-			}
+			if (in_list(&sesslist, &kp->ki_sid))
+				goto keepit;
 #endif
-			if (ttylist.count > 0) {
-				for (elem = 0; elem < ttylist.count; elem++)
-					if (kp->kp_eproc.e_tdev == ttylist.l.ttys[elem])
-						goto keepit;
-			}
-			if (uidlist.count > 0) {
-				for (elem = 0; elem < uidlist.count; elem++)
-					if (kp->kp_eproc.e_ucred.cr_uid == uidlist.l.uids[elem])
-						goto keepit;
-			}
+			if (in_list(&ttylist, &kp->kp_eproc.e_tdev))
+				goto keepit;
+			if (in_list(&uidlist, &kp->kp_eproc.e_ucred.cr_uid))
+				goto keepit;
 			/*
 			 * This process did not match any of the user's
 			 * selector-options, so skip the process.
@@ -732,82 +865,119 @@ main(int argc, char *argv[])
 			continue;
 
 		keepit:
-			next_KINFO = &kinfo[nkept];
+			next_KINFO = &kinfo[streamflg ? 0 : nkept];
 			next_KINFO->ki_p = kp;
-#if defined(__APPLE__) && !PS_ENTITLEMENT_ENFORCED
-			get_task_info(next_KINFO);
-#elif !defined(__APPLE__)
+#if !defined(__APPLE__) && !defined(__linux__)
 			next_KINFO->ki_pcpu = getpcpu(next_KINFO);
 			if (sortby == SORTMEM)
 				next_KINFO->ki_memsize = kp->ki_tsize +
 				    kp->ki_dsize + kp->ki_ssize;
-#endif /* __APPLE__ && !PS_ENTITLEMENT_ENFORCED */
-			if (needuser)
-				saveuser(next_KINFO);
-			dynsizevars(next_KINFO);
+#endif /* !__APPLE__ && !__linux__ */
 			nkept++;
+			if (streamflg)
+				streamproc(next_KINFO, collect, prtheader,
+				    &lineno);
 		}
 	}
+	if (streamflg) {
+		free(kprocbuf);
+		if (nkept == 0)
+			exit(1);
+		goto done;
+	}
 
-	sizevars();
+	/*
+	 * Gather task data and arguments for the kept processes in
+	 * parallel, then size the columns from them.  With --top, only
+	 * what the sort keys need is gathered for all of them; the rest
+	 * is left for the winners, which sort_top() moves to the front.
+	 */
+	stats_phase(ST_COLLECT);
+	if (watchint > 0)
+		watch_carry(kinfo, nkept);
+	sorted = NULL;
+	nshow = nkept;
+	if (topn > 0 && topn < nkept) {
+#if defined(__APPLE__) || defined(__linux__)
+		/* Watch mode needs everyone's times for next time's %cpu. */
+		collect_procs(kinfo, nkept, (sort_needs() & collect) |
+		    (watchint > 0 ? COLLECT_TASK : 0), njobs);
+#endif /* __APPLE__ || __linux__ */
+		if (watchint > 0)
+			watch_cpu(kinfo, nkept);
+		stats_phase(ST_SORT);
+		sorted = sort_top(kinfo, nkept, topn);
+		nshow = topn;
+		stats_phase(ST_COLLECT);
+	}
+#if defined(__APPLE__) || defined(__linux__)
+	collect_procs(kinfo, nshow, collect, njobs);
+#endif /* __APPLE__ || __linux__ */
+	if (watchint > 0)
+		watch_cpu(kinfo, nshow);
+	if (savefile != NULL) {
+		/* Saved, not shown; --load renders it later. */
+		snap_save(savefile, kinfo, nshow);
+		exit(0);
+	}
+	if (forest) {
+		/* The tree is part of the command column's width. */
+		stats_phase(ST_SORT);
+		if (sorted == NULL)
+			sorted = sort_procs(kinfo, nkept);
+		sort_forest(sorted, nshow);
+	}
+	stats_phase(ST_SIZE);
+	namecache_prime(kinfo, nshow);
+	for (i = 0; i < nshow; i++) {
+		if (needuser)
+			saveuser(&kinfo[i]);
+		if (outstyle == OUT_TEXT)
+			dynsizevars(&kinfo[i]);
+	}
+
+	if (outstyle == OUT_TEXT)
+		sizevars();
 
 	/*
-	 * print header
+	 * print header; machine-readable formats only want it once.
 	 */
-	printheader();
-	if (nkept == 0)
+	stats_phase(ST_OUTPUT);
+	if (watchint > 0 && outstyle == OUT_TEXT)
+		psout = watch_begin();
+	if (outstyle == OUT_TEXT || nsnap == 1)
+		printheader();
+	if (nkept == 0 && watchint == 0)
 		exit(1);
 
 	/*
 	 * sort proc list
 	 */
-	qsort(kinfo, nkept, sizeof(KINFO), pscomp);
+	if (sorted == NULL) {
+		stats_phase(ST_SORT);
+		sorted = sort_procs(kinfo, nkept);
+		stats_phase(ST_OUTPUT);
+	}
 	/*
 	 * For each process, call each variable output function.
 	 */
-	for (i = lineno = 0; i < nkept; i++) {
-#if !PS_ENTITLEMENT_ENFORCED
-		if(mflg) {
-			print_all_thread = 1;
-			for(j=0; j < kinfo[i].thread_count; j++) {
-			print_thread_num = j;
-			STAILQ_FOREACH(vent, &varlist, next_ve) {
-				(vent->var->oproc)(&kinfo[i], vent);
-				if (STAILQ_NEXT(vent, next_ve) != NULL)
-					(void)putchar(' ');
-			}
-
-			(void)putchar('\n');
-			if (prtheader && lineno++ == prtheader - 4) {
-				(void)putchar('\n');
-				printheader();
-				lineno = 0;
-			}
-			}
-			print_all_thread = 0;
-		} else {
-#else
-		{
-#endif
-			STAILQ_FOREACH(vent, &varlist, next_ve) {
-				(vent->var->oproc)(&kinfo[i], vent);
-				if (STAILQ_NEXT(vent, next_ve) != NULL)
-					(void)putchar(' ');
-			}
-
-			(void)putchar('\n');
-			if (prtheader && lineno++ == prtheader - 4) {
-				(void)putchar('\n');
-				printheader();
-				lineno = 0;
-			}
-		}
-	}
-	for (i = 0; i < nkept; i++) {
-		if (kinfo[i].invalid_tinfo == 0 && kinfo[i].thread_count)
-			free(kinfo[i].thval);	
+	for (i = lineno = 0; i < nshow; i++)
+		printproc(sorted[i], prtheader, &lineno);
+	if (watchint > 0) {
+		if (outstyle == OUT_TEXT) {
+			watch_end();
+			psout = stdout;
+		} else
+			(void)fflush(stdout);
+		watch_save(kinfo, nkept);
 	}
 	free(kprocbuf);
+	if (watchint > 0) {
+		stats_phase(-1);
+		watch_wait(watchint);
+		goto snapshot;
+	}
+done:
 	free(kinfo);
 	free_list(&gidlist);
 	free_list(&pidlist);
@@ -827,10 +997,11 @@ main(int argc, char *argv[])
 static int
 addelem_gid(struct listinfo *inf, const char *elem)
 {
-	struct group *grp;
 	const char *nameorID;
 	char *endp;
 	u_long bigtemp;
+	gid_t gid;
+	int found;
 
 	if (*elem == '\0' || strlen(elem) >= MAXLOGNAME) {
 		if (*elem == '\0')
@@ -850,28 +1021,33 @@ addelem_gid(struct listinfo *inf, const char *elem)
 	 * practice the order would only matter for group-names which
 	 * are all-numeric.
 	 */
-	grp = NULL;
+	found = 0;
 	nameorID = "named";
 	errno = 0;
 	bigtemp = strtoul(elem, &endp, 10);
 	if (errno == 0 && *endp == '\0' && bigtemp <= GID_MAX) {
 		nameorID = "name or ID matches";
-		grp = getgrgid((gid_t)bigtemp);
+		gid = (gid_t)bigtemp;
+		found = nc_group(gid, 1) != NULL;
 	}
-	if (grp == NULL)
-		grp = getgrnam(elem);
-	if (grp == NULL) {
+	if (!found)
+		found = nc_gid_by_name(elem, &gid) == 0;
+	if (!found) {
 		warnx("No %s %s '%s'", inf->lname, nameorID, elem);
 		optfatal = 1;
 		return (0);
 	}
 	if (inf->count >= inf->maxcount)
 		expand_list(inf);
-	inf->l.gids[(inf->count)++] = grp->gr_gid;
+	inf->l.gids[(inf->count)++] = gid;
 	return (1);
 }
 
+#ifdef __linux__
+#define	BSD_PID_MAX	INT_MAX		/* kernel.pid_max can go up to 2^22. */
+#else
 #define	BSD_PID_MAX	99999		/* Copy of PID_MAX from sys/proc.h. */
+#endif
 static int
 addelem_pid(struct listinfo *inf, const char *elem)
 {
@@ -980,9 +1156,10 @@ addelem_tty(struct listinfo *inf, const char *elem)
 static int
 addelem_uid(struct listinfo *inf, const char *elem)
 {
-	struct passwd *pwd;
 	char *endp;
 	u_long bigtemp;
+	uid_t uid;
+	int found;
 
 	if (*elem == '\0' || strlen(elem) >= MAXLOGNAME) {
 		if (*elem == '\0')
@@ -993,21 +1170,22 @@ addelem_uid(struct listinfo *inf, const char *elem)
 		return (0);		/* Do not add this value. */
 	}
 
-	pwd = getpwnam(elem);
-	if (pwd == NULL) {
+	found = nc_uid_by_name(elem, &uid) == 0;
+	if (!found) {
 		errno = 0;
 		bigtemp = strtoul(elem, &endp, 10);
 		if (errno != 0 || *endp != '\0' || bigtemp > UID_MAX)
 			warnx("No %s named '%s'", inf->lname, elem);
 		else {
 			/* The string is all digits, so it might be a userID. */
-			pwd = getpwuid((uid_t)bigtemp);
-			if (pwd == NULL)
+			uid = (uid_t)bigtemp;
+			found = nc_user(uid, 1) != NULL;
+			if (!found)
 				warnx("No %s name or ID matches '%s'",
 				    inf->lname, elem);
 		}
 	}
-	if (pwd == NULL) {
+	if (!found) {
 		/*
 		 * These used to be treated as minor warnings (and the
 		 * option was simply ignored), but now they are fatal
@@ -1018,7 +1196,7 @@ addelem_uid(struct listinfo *inf, const char *elem)
 	}
 	if (inf->count >= inf->maxcount)
 		expand_list(inf);
-	inf->l.uids[(inf->count)++] = pwd->pw_uid;
+	inf->l.uids[(inf->count)++] = uid;
 	return (1);
 }
 
@@ -1110,6 +1288,8 @@ free_list(struct listinfo *inf)
 	inf->addelem = NULL;
 	inf->lname = NULL;
 	inf->l.ptr = NULL;
+	free(inf->hash);
+	inf->hash = NULL;
 }
 
 static void
@@ -1122,6 +1302,83 @@ init_list(struct listinfo *inf, addelem_rtn artn, int elemsize,
 	inf->addelem = artn;
 	inf->lname = lname;
 	inf->l.ptr = NULL;
+	inf->hash = NULL;
+}
+
+/*
+ * Selector lists can be long (-p with thousands of pids), and every
+ * process is checked against every list, so once the lists are complete
+ * each one is turned into an open-addressing hash set.
+ */
+static inline uint64_t
+list_key(const struct listinfo *inf, const void *elem)
+{
+	uint32_t k32;
+	uint64_t k64;
+
+	if (inf->elemsize == sizeof(k64)) {
+		memcpy(&k64, elem, sizeof(k64));
+		return (k64);
+	}
+	memcpy(&k32, elem, sizeof(k32));
+	return (k32);
+}
+
+#define	LIST_SLOT(inf, key) \
+	((size_t)(((key) * 0x9e3779b97f4a7c15ULL) >> (inf)->hashshift))
+
+static void
+hash_list(struct listinfo *inf)
+{
+	uint64_t key;
+	size_t nslots, mask, slot;
+	int bits, elem;
+
+	if (inf->count == 0)
+		return;
+	/* At most half full. */
+	for (bits = 1; ((size_t)1 << bits) < (size_t)inf->count * 2; bits++)
+		;
+	nslots = (size_t)1 << bits;
+	mask = nslots - 1;
+	free(inf->hash);
+	if ((inf->hash = malloc(nslots * sizeof(*inf->hash))) == NULL)
+		errx(1, "malloc failed");
+	memset(inf->hash, 0xff, nslots * sizeof(*inf->hash));
+	inf->hashshift = 64 - bits;
+	inf->hashfull = 0;
+
+	for (elem = 0; elem < inf->count; elem++) {
+		key = list_key(inf, (char *)inf->l.ptr + elem * inf->elemsize);
+		if (key == HASH_EMPTY) {
+			inf->hashfull = 1;
+			continue;
+		}
+		for (slot = LIST_SLOT(inf, key); inf->hash[slot] != HASH_EMPTY;
+		    slot = (slot + 1) & mask)
+			if (inf->hash[slot] == key)
+				break;
+		inf->hash[slot] = key;
+	}
+}
+
+static int
+in_list(const struct listinfo *inf, const void *elem)
+{
+	uint64_t key;
+	size_t mask, slot;
+
+	if (inf->hash == NULL)
+		return (0);
+	key = list_key(inf, elem);
+	if (key == HASH_EMPTY)
+		return (inf->hashfull);
+	mask = ((size_t)1 << (64 - inf->hashshift)) - 1;
+	for (slot = LIST_SLOT(inf, key); inf->hash[slot] != HASH_EMPTY;
+	    slot = (slot + 1) & mask)
+		if (inf->hash[slot] == key)
+			return (1);
+	return (0);
 }
 
 VARENT *
@@ -1152,6 +1409,13 @@ scanvars(void)
 			needuser = 1;
 		if (v->flag & COMM)
 			needcomm = 1;
+		needdata |= varcollect(v);
+#ifdef __linux__
+		if (v->oproc == rvar &&
+		    (v->off == offsetof(struct rusage, ru_inblock) ||
+		    v->off == offsetof(struct rusage, ru_oublock)))
+			needio = 1;
+#endif
 	}
 }
 
@@ -1181,6 +1445,7 @@ sizevars(void)
 	VAR *v;
 	int i;
 
+	totwidth = 0;
 	STAILQ_FOREACH(vent, &varlist, next_ve) {
 		v = vent->var;
 		i = strlen(vent->header);
@@ -1191,7 +1456,74 @@ sizevars(void)
 	totwidth--;
 }
 
-#ifndef __APPLE__
+/*
+ * Size the columns without looking at any processes, for --stream: the
+ * dynamically sized ones get the widths their keywords declare.
+ */
+static void
+fixvars(void)
+{
+	struct varent *vent;
+	VAR *v;
+
+	STAILQ_FOREACH(vent, &varlist, next_ve) {
+		v = vent->var;
+		if (v->flag & DSIZ)
+			v->width = v->dwidth;
+	}
+	sizevars();
+}
+
+/*
+ * Print the row for k, or with -M one for each of its threads, repeating
+ * the header every prtheader lines.
+ */
+static void
+printproc(KINFO *k, int prtheader, int *lineno)
+{
+	unsigned int j, nrows;
+
+	nrows = 1;
+#if !PS_ENTITLEMENT_ENFORCED
+	if (mflg) {
+		print_all_thread = 1;
+		nrows = k->thread_count;
+	}
+#endif
+	for (j = 0; j < nrows; j++) {
+		print_thread_num = j;
+		printrow(k);
+		if (prtheader && (*lineno)++ == prtheader - 4) {
+			(void)putc('\n', psout);
+			printheader();
+			*lineno = 0;
+		}
+	}
+	print_all_thread = 0;
+}
+
+/*
+ * --stream: gather what the columns need for one process, print it and
+ * forget it, so that output starts at once and memory use stays flat.
+ */
+static void
+streamproc(KINFO *k, int collect, int prtheader, int *lineno)
+{
+
+	stats_phase(ST_COLLECT);
+#if defined(__APPLE__) || defined(__linux__)
+	collect_procs(k, 1, collect, 1);
+#endif /* __APPLE__ || __linux__ */
+	if (needuser)
+		saveuser(k);
+	stats_phase(ST_OUTPUT);
+	printproc(k, prtheader, lineno);
+	arena_reset(curarena);
+	memset(k, 0, sizeof(*k));
+	stats_phase(ST_SELECT);
+}
+
+#if !defined(__APPLE__) && !defined(__linux__)
 static const char *
 fmt(char **(*fn)(kvm_t *, const struct kinfo_proc *, int), KINFO *ki,
     char *comm, int maxlen)
@@ -1201,7 +1533,7 @@ fmt(char **(*fn)(kvm_t *, const struct kinfo_proc *, int), KINFO *ki,
 	s = fmt_argv((*fn)(kd, ki->ki_p, termwidth), comm, maxlen);
 	return (s);
 }
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 
 #define UREADOK(ki)	(forceuread || (KI_PROC(ki)->p_flag & P_INMEM))
 
@@ -1230,6 +1562,22 @@ saveuser(KINFO *ki)
 		usp->u_valid = 1;
 	} else
 		usp->u_valid = 0;
+#elif defined(__linux__)
+	{
+		const struct procstat *ps = &ki->ki_p->kp_stat;
+		const struct pidio *pio;
+
+		/* stat and status are in already; io only if asked for. */
+		usp->u_ru.ru_minflt = ps->ps_minflt;
+		usp->u_ru.ru_majflt = ps->ps_majflt;
+		usp->u_ru.ru_nvcsw = ps->ps_nvcsw;
+		usp->u_ru.ru_nivcsw = ps->ps_nivcsw;
+		if (needio && (pio = get_pidsrc(ki, SRC_IO)) != NULL) {
+			usp->u_ru.ru_inblock = pio->pio_rbytes / 512;
+			usp->u_ru.ru_oublock = pio->pio_wbytes / 512;
+		}
+		usp->u_valid = 1;
+	}
 #else /* FIXME */
 		usp->u_valid = 0;
 #endif /* FIXME */
@@ -1247,8 +1595,7 @@ saveuser(KINFO *ki)
 	    ki->ki_args = NULL;
     }
 #else /* FIXME */
-	    ki->ki_args = malloc(strlen(KI_PROC(ki)->p_comm) + 3);
-	    sprintf(ki->ki_args, "%s", KI_PROC(ki)->p_comm);
+	    ki->ki_args = astrdup(KI_PROC(ki)->p_comm);
 	    //ki->ki_args = malloc(10);
 	    //strcpy(ki->ki_args, "()");
 #endif /* FIXME */
@@ -1262,40 +1609,10 @@ saveuser(KINFO *ki)
 	    ki->ki_env = NULL;
     }
 #else /* FIXME */
-	    ki->ki_env = malloc(10);
-	    strcpy(ki->ki_env, "");
+	    ki->ki_env = astrdup("");
 #endif /* FIXME */
 }
 
-static int
-pscomp(const void *a, const void *b)
-{
-	int i;
-#if FIXME
-#define VSIZE(k) (KI_EPROC(k)->e_vm.vm_dsize + KI_EPROC(k)->e_vm.vm_ssize + \
-		  KI_EPROC(k)->e_vm.vm_tsize)
-#else /* FIXME */
-#define VSIZE(k) ((k)->tasks_info.resident_size)
-
-#endif /* FIXME */
-
-	if (sortby == SORTCPU)
-		return (getpcpu((KINFO *)b) - getpcpu((KINFO *)a));
-#if PS_ENTITLEMENT_ENFORCED
-	/*
-	 * rdar://problem/84512155 - tasks_info is not available in the
-	 * unentitled ps build.  It's forbidden elsewhere.
-	 */
-	assert(sortby != SORTMEM);
-#endif
-	if (sortby == SORTMEM)
-		return (VSIZE((KINFO *)b) - VSIZE((KINFO *)a));
-	i =  KI_EPROC((KINFO *)a)->e_tdev - KI_EPROC((KINFO *)b)->e_tdev;
-	if (i == 0)
-		i = KI_PROC((KINFO *)a)->p_pid - KI_PROC((KINFO *)b)->p_pid;
-	return (i);
-}
-
 /*
  * ICK (all for getopt), would rather hide the ugliness
  * here than taint the main code.
@@ -1398,7 +1715,7 @@ kludge_oldps_options(const char *optlist, char *origval, const char *nextarg, in
 	return (newopts);
 }
 
-#ifndef __APPLE__
+#if !defined(__APPLE__) && !defined(__linux__)
 static int
 check_procfs(void)
 {
@@ -1410,15 +1727,19 @@ check_procfs(void)
 		return (0);
 	return (1);
 }
-#endif /* !__APPLE__ */
+#endif /* !__APPLE__ && !__linux__ */
 
 static void
 usage(int u03)
 {
 #define	SINGLE_OPTS	"[-AaCcEefhjlMmrSTvwXx]"
 
-	(void)fprintf(stderr, "%s\n%s\n%s\n%s\n",
+	(void)fprintf(stderr, "%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n",
 	    "usage: ps " SINGLE_OPTS " [-O fmt | -o fmt] [-G gid[,gid...]]",
+	    "          [-J jobs] [-W interval] [--forest]",
+	    "          [--format=text|json|csv|tsv|bin]",
+	    "          [--sort=[-]key[,[-]key...]] [--top=n] [--stream]",
+	    "          [--save=file] [--load=file] [--stats]",
 	    (u03 ? "          [-g grp[,grp...]] [-u [uid,uid...]]" : "          [-u]"),
 	    "          [-p pid[,pid...]] [-t tty[,tty...]] [-U user[,user...]]",
 	    "       ps [-L]");
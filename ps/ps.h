@@ -42,6 +42,7 @@
 #include <mach/policy.h>
 #include <mach/task_info.h>
 #include <mach/thread_info.h>
+#include <sys/proc_info.h>
 
 #include <TargetConditionals.h>
 
@@ -50,6 +51,8 @@
 #else
 #define	PS_ENTITLEMENT_ENFORCED 0
 #endif /* !PS_ENTITLED && TARGET_OS_OSX */
+#elif defined(__linux__)
+#include "linux.h"
 #endif /* __APPLE__ */
 
 #define	UNLIMITED	0	/* unlimited terminal width */
@@ -63,6 +66,21 @@ struct usave {
 	char	u_valid;
 };
 
+/*
+ * Per-process data sources that only some columns use.  Each is fetched
+ * the first time one of those columns asks for it, see get_pidsrc(), so
+ * any number of columns drawing on one source cost one call per process.
+ */
+#define	SRC_WQ		0	/* struct proc_workqueueinfo */
+#define	SRC_PERSONA	1	/* uint32_t persona id */
+#define	SRC_IO		2	/* struct pidio */
+#define	SRC_MAX		3
+
+struct pidio {
+	unsigned long long pio_rbytes;	/* read from storage */
+	unsigned long long pio_wbytes;	/* written to storage */
+};
+
 #define KI_PROC(ki) (&(ki)->ki_p->kp_proc)
 #define KI_EPROC(ki) (&(ki)->ki_p->kp_eproc)
 
@@ -81,6 +99,15 @@ typedef struct kinfo {
 	struct usave ki_u;	/* interesting parts of user */
 	char *ki_args;		/* exec args */
 	char *ki_env;		/* environment */
+	char *ki_procargs;	/* raw argument area, see getproclline() */
+	size_t ki_procargsize;
+	int ki_procargsok;	/* 1 fetched, -1 unavailable, 0 not yet */
+	char *ki_cmdstr[4];	/* rendered command/args, by show_cmd/show_args */
+	int ki_cmdlen[4];
+	char *ki_prefix;	/* --forest: tree drawn before the command */
+	int ki_have;		/* COLLECT_* already done */
+	int ki_srcdone;		/* SRC_* already tried, as bits */
+	void *ki_src[SRC_MAX];	/* from get_pidsrc(), NULL if unavailable */
         task_port_t task;
 	int state;
 	int cpu_usage;
@@ -102,6 +129,67 @@ typedef struct kinfo {
 	int	invalid_thinfo;
 } KINFO;
 
+/*
+ * Process sources.  A source produces the raw kinfo_proc table for a
+ * sysctl(3)-style selector, then fills in the task data and the argument
+ * area of each process that ps decides to keep.  The argument area is
+ * returned in KERN_PROCARGS2 layout (argc, exec path, argv, envv) so that
+ * the command-line parsing in print.c is shared by all sources.
+ */
+typedef struct procsource {
+	const char *name;
+					/* fetch the process table */
+	struct kinfo_proc *(*getprocs)(int what, int flag, int *nentries);
+					/* fill in task/thread data */
+	int	(*taskinfo)(struct kinfo *, int what);
+					/* argument area, from curarena */
+	char	*(*procargs)(struct kinfo *, size_t *);
+					/* one SRC_* source: 0, or -1 */
+	int	(*pidinfo)(struct kinfo *, int src, void *buf);
+} PROCSOURCE;
+
+/* Bump allocator, see arena.c. */
+struct arena_chunk;
+typedef struct arena {
+	struct arena_chunk *first;	/* all chunks, in the order used */
+	struct arena_chunk *cur;	/* chunk being carved up */
+	size_t	chunksize;		/* 0 for the default */
+	struct arena *sub;		/* per-worker arenas */
+	int	nsub;
+} ARENA;
+
+/* What collect_procs() should gather for each kept process. */
+#define	COLLECT_TASK	0x01		/* procsrc->taskinfo, task-wide */
+#define	COLLECT_ARGS	0x02		/* procsrc->procargs */
+#define	COLLECT_THREADS	0x04		/* procsrc->taskinfo, per-thread */
+
+/* Output styles (--format), see outfmt.c. */
+#define	OUT_TEXT	0		/* aligned columns */
+#define	OUT_JSON	1
+#define	OUT_CSV		2
+#define	OUT_TSV		3
+#define	OUT_BIN		4
+
+/* Phases and counters for --stats, see stats.c. */
+#define	ST_FETCH	0		/* procsrc->getprocs */
+#define	ST_SELECT	1
+#define	ST_COLLECT	2
+#define	ST_SIZE		3
+#define	ST_SORT		4
+#define	ST_OUTPUT	5
+#define	ST_NPHASE	6
+
+#define	ST_ALLOCS	0
+#define	ST_ALLOCBYTES	1
+#define	ST_SYSCALLS	2
+#define	ST_RETRIES	3		/* of the process table fetch */
+#define	ST_NCOUNT	4
+
+#define	STATS_ADD(which, n) do {					\
+	if (psstats)							\
+		stats_add((which), (n));				\
+} while (0)
+
 /* Variables. */
 typedef struct varent {
 	STAILQ_ENTRY(varent) next_ve;
@@ -118,6 +206,8 @@ typedef struct var {
 #define	USER	0x04		/* needs user structure */
 #define	DSIZ	0x08		/* field size is dynamic*/
 #define	INF127	0x10		/* values >127 displayed as 127 */
+#define	TASKINFO 0x20		/* needs task-wide data */
+#define	THRINFO	0x40		/* needs per-thread data */
 #ifdef __APPLE__
 #define	ENTITLED	0x80000000	/* Needs entitlements */
 #endif
@@ -141,4 +231,19 @@ typedef struct var {
 	 */
 } VAR;
 
+/*
+ * A compiled output column, see fmtcompile().  Simple numeric fields get
+ * a print routine specialized for their type, with their address and
+ * printf format worked out in advance; anything else goes through the
+ * keyword's own output routine.
+ */
+typedef struct field {
+	void	(*print)(struct kinfo *, const struct field *);
+	VARENT	*ve;
+	VAR	*v;
+	size_t	off;		/* from ki_p, or from the KINFO for ki_u */
+	const char *ofmt;	/* complete printf format */
+	char	fmtbuf[32];
+} FIELD;
+
 #include "extern.h"
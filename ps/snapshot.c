@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Process table snapshots: --save and --load.
+ *
+ * --save writes the processes ps selected, with their task data, thread
+ * data and argument areas, to a file; --load makes that file the process
+ * source, so that any format can be rendered from it later without
+ * looking at the live system.  The file is laid out to be mapped and used
+ * in place:
+ *
+ *	struct snaphdr
+ *	struct kinfo_proc	[nprocs]
+ *	struct snaprec		[nprocs]	task and get_pidsrc() data, and
+ *						where the rest is
+ *	thread_values_t		[...]		every process's threads in turn
+ *	argument areas				KERN_PROCARGS2 layout
+ *
+ * Each section starts on a SNAP_ALIGN boundary.  The records are the
+ * in-memory structures, so a file can only be read by a ps built for
+ * the same platform; the header carries enough to reject anything else.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ps.h"
+
+#define	SNAP_MAGIC	"ps-snap\n"
+#define	SNAP_VERSION	2
+#define	SNAP_ORDER	0x01020304	/* as written by the saving host */
+#define	SNAP_ALIGN	16
+
+struct snaphdr {
+	char	sh_magic[8];
+	uint32_t sh_version;
+	uint32_t sh_order;
+	uint32_t sh_kpsize;		/* sizeof(struct kinfo_proc) */
+	uint32_t sh_recsize;		/* sizeof(struct snaprec) */
+	uint32_t sh_tvsize;		/* sizeof(thread_values_t) */
+	uint32_t sh_nprocs;
+	int64_t	sh_time;		/* when it was taken */
+	uint64_t sh_mempages;		/* see donlist() */
+	uint64_t sh_procoff;		/* file offsets of the sections */
+	uint64_t sh_recoff;
+	uint64_t sh_thoff;
+	uint64_t sh_argoff;
+	uint64_t sh_size;		/* of the whole file */
+};
+
+struct snaprec {
+	struct task_basic_info sr_tasks_info;
+	struct task_thread_times_info sr_times;
+	union {
+		struct policy_timeshare_info tshare;
+		struct policy_rr_info rr;
+		struct policy_fifo_info fifo;
+	} sr_schedinfo;
+	int32_t	sr_have;		/* COLLECT_* that were done */
+	int32_t	sr_state;
+	int32_t	sr_cpu_usage;
+	int32_t	sr_curpri;
+	int32_t	sr_basepri;
+	int32_t	sr_swapped;
+	int32_t	sr_invalid_tinfo;
+	int32_t	sr_invalid_thinfo;
+	uint32_t sr_thread_count;
+	int32_t	sr_argsok;		/* ki_procargsok */
+	uint64_t sr_thread;		/* first thread, in thread_values_t */
+	uint64_t sr_args;		/* from the start of the args section */
+	uint64_t sr_argsize;
+	int32_t	sr_srcok;		/* SRC_* saved, as bits */
+	uint32_t sr_persona;		/* SRC_PERSONA */
+	struct proc_workqueueinfo sr_wq; /* SRC_WQ */
+	struct pidio sr_io;		/* SRC_IO */
+};
+
+static char	*snapbase;		/* the mapped file */
+static const struct snaphdr *snaphdr;
+static struct kinfo_proc *snapprocs;	/* last table handed out */
+static uint32_t	*snapidx;		/* and the record for each entry */
+
+static uint64_t
+snap_align(uint64_t off)
+{
+	return ((off + SNAP_ALIGN - 1) & ~(uint64_t)(SNAP_ALIGN - 1));
+}
+
+static void
+snap_write(FILE *fp, const char *path, const void *buf, size_t len,
+    uint64_t *off)
+{
+	if (len > 0 && fwrite(buf, len, 1, fp) != 1)
+		err(1, "%s", path);
+	*off += len;
+}
+
+/* Zero-fill up to the next section. */
+static void
+snap_pad(FILE *fp, const char *path, uint64_t *off)
+{
+	static const char zero[SNAP_ALIGN];
+
+	snap_write(fp, path, zero, snap_align(*off) - *off, off);
+}
+
+/*
+ * Write kinfo[0..n-1], and whatever was collected for them, to path.
+ */
+void
+snap_save(const char *path, KINFO *kinfo, int n)
+{
+	struct snaphdr h;
+	struct snaprec r;
+	uint64_t nthreads, args, off;
+	const void *src;
+	KINFO *k;
+	FILE *fp;
+	int i;
+
+	nthreads = args = 0;
+	for (i = 0; i < n; i++) {
+		k = &kinfo[i];
+		if (k->ki_have & COLLECT_THREADS)
+			nthreads += k->thread_count;
+		if (k->ki_procargsok > 0)
+			args += snap_align(k->ki_procargsize);
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.sh_magic, SNAP_MAGIC, sizeof(h.sh_magic));
+	h.sh_version = SNAP_VERSION;
+	h.sh_order = SNAP_ORDER;
+	h.sh_kpsize = sizeof(struct kinfo_proc);
+	h.sh_recsize = sizeof(struct snaprec);
+	h.sh_tvsize = sizeof(thread_values_t);
+	h.sh_nprocs = n;
+	h.sh_time = now;
+	if (!nlistread)
+		(void)donlist();
+	h.sh_mempages = mempages;
+	h.sh_procoff = snap_align(sizeof(h));
+	h.sh_recoff = snap_align(h.sh_procoff +
+	    (uint64_t)n * sizeof(struct kinfo_proc));
+	h.sh_thoff = snap_align(h.sh_recoff + (uint64_t)n * sizeof(r));
+	h.sh_argoff = snap_align(h.sh_thoff +
+	    nthreads * sizeof(thread_values_t));
+	h.sh_size = h.sh_argoff + args;
+
+	if ((fp = fopen(path, "w")) == NULL)
+		err(1, "%s", path);
+	off = 0;
+	snap_write(fp, path, &h, sizeof(h), &off);
+	snap_pad(fp, path, &off);
+	for (i = 0; i < n; i++)
+		snap_write(fp, path, kinfo[i].ki_p, sizeof(struct kinfo_proc),
+		    &off);
+	snap_pad(fp, path, &off);
+
+	nthreads = args = 0;
+	for (i = 0; i < n; i++) {
+		k = &kinfo[i];
+		memset(&r, 0, sizeof(r));
+		r.sr_tasks_info = k->tasks_info;
+		r.sr_times = k->times;
+		memcpy(&r.sr_schedinfo, &k->schedinfo, sizeof(r.sr_schedinfo));
+		r.sr_have = k->ki_have & (COLLECT_TASK | COLLECT_THREADS);
+		r.sr_state = k->state;
+		r.sr_cpu_usage = k->cpu_usage;
+		r.sr_curpri = k->curpri;
+		r.sr_basepri = k->basepri;
+		r.sr_swapped = k->swapped;
+		r.sr_invalid_tinfo = k->invalid_tinfo;
+		r.sr_invalid_thinfo = k->invalid_thinfo;
+		if (k->ki_have & COLLECT_THREADS) {
+			r.sr_thread_count = k->thread_count;
+			r.sr_thread = nthreads;
+			nthreads += k->thread_count;
+		}
+		r.sr_argsok = k->ki_procargsok > 0 ? 1 : -1;
+		if (k->ki_procargsok > 0) {
+			r.sr_args = args;
+			r.sr_argsize = k->ki_procargsize;
+			args += snap_align(k->ki_procargsize);
+		}
+		/* Whichever columns are asked for later will want these. */
+		if ((src = get_pidsrc(k, SRC_WQ)) != NULL) {
+			memcpy(&r.sr_wq, src, sizeof(r.sr_wq));
+			r.sr_srcok |= 1 << SRC_WQ;
+		}
+		if ((src = get_pidsrc(k, SRC_PERSONA)) != NULL) {
+			memcpy(&r.sr_persona, src, sizeof(r.sr_persona));
+			r.sr_srcok |= 1 << SRC_PERSONA;
+		}
+		if ((src = get_pidsrc(k, SRC_IO)) != NULL) {
+			memcpy(&r.sr_io, src, sizeof(r.sr_io));
+			r.sr_srcok |= 1 << SRC_IO;
+		}
+		snap_write(fp, path, &r, sizeof(r), &off);
+	}
+	snap_pad(fp, path, &off);
+	for (i = 0; i < n; i++) {
+		k = &kinfo[i];
+		if (k->ki_have & COLLECT_THREADS)
+			snap_write(fp, path, k->thval,
+			    k->thread_count * sizeof(thread_values_t), &off);
+	}
+	snap_pad(fp, path, &off);
+	for (i = 0; i < n; i++) {
+		k = &kinfo[i];
+		if (k->ki_procargsok > 0) {
+			snap_write(fp, path, k->ki_procargs,
+			    k->ki_procargsize, &off);
+			snap_pad(fp, path, &off);
+		}
+	}
+	if (off != h.sh_size)
+		errx(1, "%s: wrote %llu bytes, expected %llu", path,
+		    (unsigned long long)off, (unsigned long long)h.sh_size);
+	if (fclose(fp) != 0)
+		err(1, "%s", path);
+}
+
+/*
+ * Does every section lie inside the file, in order, and does every
+ * record's thread range and argument area lie inside its section?  The
+ * readers below use these offsets as they are, so nothing is mapped in
+ * until this has been checked.
+ */
+static int
+snap_valid(const struct snaphdr *h, uint64_t size)
+{
+	const struct snaprec *r;
+	uint64_t nthreads, argsize;
+	uint32_t i;
+
+	if (h->sh_size != size ||
+	    h->sh_procoff < sizeof(*h) || h->sh_procoff % SNAP_ALIGN != 0 ||
+	    h->sh_recoff % SNAP_ALIGN != 0 || h->sh_thoff % SNAP_ALIGN != 0 ||
+	    h->sh_argoff % SNAP_ALIGN != 0 ||
+	    h->sh_recoff < h->sh_procoff ||
+	    (uint64_t)h->sh_nprocs * h->sh_kpsize >
+	    h->sh_recoff - h->sh_procoff ||
+	    h->sh_thoff < h->sh_recoff ||
+	    (uint64_t)h->sh_nprocs * h->sh_recsize >
+	    h->sh_thoff - h->sh_recoff ||
+	    h->sh_argoff < h->sh_thoff || h->sh_size < h->sh_argoff)
+		return (0);
+
+	nthreads = (h->sh_argoff - h->sh_thoff) / h->sh_tvsize;
+	argsize = h->sh_size - h->sh_argoff;
+	r = (const struct snaprec *)(snapbase + h->sh_recoff);
+	for (i = 0; i < h->sh_nprocs; i++, r++) {
+		if ((r->sr_have & COLLECT_THREADS) &&
+		    (r->sr_thread > nthreads ||
+		    r->sr_thread_count > nthreads - r->sr_thread))
+			return (0);
+		if (r->sr_argsok > 0 &&
+		    (r->sr_args > argsize ||
+		    r->sr_argsize > argsize - r->sr_args))
+			return (0);
+	}
+	return (1);
+}
+
+/*
+ * Map a snapshot and make it the process source.
+ */
+void
+snap_open(const char *path)
+{
+	const struct snaphdr *h;
+	struct stat sb;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 ||
+	    fstat(fd, &sb) == -1)
+		err(1, "%s", path);
+	if ((size_t)sb.st_size < sizeof(*h))
+		errx(1, "%s: not a ps snapshot", path);
+	/* Private and writable: the command-line code edits in place. */
+	snapbase = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+	    fd, 0);
+	if (snapbase == MAP_FAILED)
+		err(1, "%s", path);
+	(void)close(fd);
+
+	h = (const struct snaphdr *)snapbase;
+	if (memcmp(h->sh_magic, SNAP_MAGIC, sizeof(h->sh_magic)) != 0)
+		errx(1, "%s: not a ps snapshot", path);
+	if (h->sh_version != SNAP_VERSION)
+		errx(1, "%s: unsupported snapshot version %u", path,
+		    h->sh_version);
+	if (h->sh_order != SNAP_ORDER ||
+	    h->sh_kpsize != sizeof(struct kinfo_proc) ||
+	    h->sh_recsize != sizeof(struct snaprec) ||
+	    h->sh_tvsize != sizeof(thread_values_t))
+		errx(1, "%s: snapshot is from another kind of system", path);
+	if (!snap_valid(h, (uint64_t)sb.st_size))
+		errx(1, "%s: snapshot is truncated or corrupt", path);
+	snaphdr = h;
+
+	/* Render times and percentages as they were when it was taken. */
+	(void)donlist();
+	mempages = h->sh_mempages;
+	nlistread = 1;
+	procsrc = &snap_source;
+}
+
+static const struct snaprec *
+snap_rec(KINFO *ki)
+{
+	return ((const struct snaprec *)(snapbase + snaphdr->sh_recoff) +
+	    snapidx[ki->ki_p - snapprocs]);
+}
+
+static int
+snap_match(const struct kinfo_proc *kp, int what, int flag)
+{
+
+	switch (what) {
+	case KERN_PROC_PID:
+		return (kp->kp_proc.p_pid == (pid_t)flag);
+	case KERN_PROC_PGRP:
+		return (kp->kp_eproc.e_pgid == (pid_t)flag);
+	case KERN_PROC_TTY:
+		return (kp->kp_eproc.e_tdev == (dev_t)flag);
+	case KERN_PROC_UID:
+		return (kp->kp_eproc.e_ucred.cr_uid == (uid_t)flag);
+	case KERN_PROC_RUID:
+		return (kp->kp_eproc.e_pcred.p_ruid == (uid_t)flag);
+	default:
+		return (1);
+	}
+}
+
+/*
+ * The processes in the file that match the selector, as a table the
+ * caller frees.  The clock is the snapshot's.
+ */
+static struct kinfo_proc *
+snap_getprocs(int what, int flag, int *nentries)
+{
+	const struct kinfo_proc *all;
+	struct kinfo_proc *kp;
+	uint32_t i, n;
+
+	now = (time_t)snaphdr->sh_time;
+	free(snapidx);
+	n = snaphdr->sh_nprocs;
+	if ((kp = malloc((n > 0 ? n : 1) * sizeof(*kp))) == NULL ||
+	    (snapidx = malloc((n > 0 ? n : 1) * sizeof(*snapidx))) == NULL)
+		errx(1, "malloc failed");
+	all = (const struct kinfo_proc *)(snapbase + snaphdr->sh_procoff);
+	for (i = n = 0; i < snaphdr->sh_nprocs; i++) {
+		if (!snap_match(&all[i], what, flag))
+			continue;
+		kp[n] = all[i];
+		snapidx[n++] = i;
+	}
+	snapprocs = kp;
+	*nentries = n;
+	return (kp);
+}
+
+static int
+snap_taskinfo(KINFO *ki, int what)
+{
+	const struct snaprec *r;
+
+	r = snap_rec(ki);
+	if ((what & COLLECT_TASK) && (r->sr_have & COLLECT_TASK)) {
+		ki->tasks_info = r->sr_tasks_info;
+		ki->times = r->sr_times;
+		memcpy(&ki->schedinfo, &r->sr_schedinfo,
+		    sizeof(ki->schedinfo));
+		ki->cpu_usage = r->sr_cpu_usage;
+		ki->curpri = r->sr_curpri;
+		ki->basepri = r->sr_basepri;
+		ki->state = r->sr_state;
+		ki->swapped = r->sr_swapped;
+		ki->invalid_tinfo = r->sr_invalid_tinfo;
+	} else if (what & COLLECT_TASK)
+		ki->invalid_tinfo = 1;
+	if ((what & COLLECT_THREADS) && (r->sr_have & COLLECT_THREADS)) {
+		ki->thread_count = r->sr_thread_count;
+		ki->thval = (thread_values_t *)(snapbase + snaphdr->sh_thoff) +
+		    r->sr_thread;
+		ki->state = r->sr_state;
+		ki->cpu_usage = r->sr_cpu_usage;
+		ki->curpri = r->sr_curpri;
+		ki->invalid_thinfo = r->sr_invalid_thinfo;
+	}
+	return (ki->invalid_tinfo);
+}
+
+static char *
+snap_procargs(KINFO *ki, size_t *sizep)
+{
+	const struct snaprec *r;
+
+	r = snap_rec(ki);
+	if (r->sr_argsok <= 0)
+		return (NULL);
+	*sizep = r->sr_argsize;
+	return (snapbase + snaphdr->sh_argoff + r->sr_args);
+}
+
+static int
+snap_pidinfo(KINFO *ki, int src, void *buf)
+{
+	const struct snaprec *r;
+
+	r = snap_rec(ki);
+	if ((r->sr_srcok & (1 << src)) == 0)
+		return (-1);
+	switch (src) {
+	case SRC_WQ:
+		memcpy(buf, &r->sr_wq, sizeof(r->sr_wq));
+		break;
+	case SRC_PERSONA:
+		memcpy(buf, &r->sr_persona, sizeof(r->sr_persona));
+		break;
+	case SRC_IO:
+		memcpy(buf, &r->sr_io, sizeof(r->sr_io));
+		break;
+	default:
+		return (-1);
+	}
+	return (0);
+}
+
+const PROCSOURCE snap_source = {
+	"snapshot",
+	snap_getprocs,
+	snap_taskinfo,
+	snap_procargs,
+	snap_pidinfo,
+};
@@ -0,0 +1,713 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Sorting the process list.
+ *
+ * The order is a list of keywords from the var[] table, each ascending
+ * or, with a leading '-', descending; the pid is always the last key.
+ * Before sorting, each key is extracted once per process into a sort
+ * record.  Numeric keys are stored as 64-bit values whose unsigned order
+ * is the wanted order, so that comparing them needs no knowledge of the
+ * keyword, and a list of numeric keys is sorted with an LSD radix sort.
+ * Keys that only exist as text (names, commands, states) are rendered
+ * once and sorted with a merge sort over the cached strings.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <err.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps.h"
+
+#define	SORT_MAXKEYS	16
+
+/* How a key is obtained from a KINFO. */
+enum sortkind {
+	SK_PROC,		/* pvar: field of kp_proc */
+	SK_EPROC,		/* evar: field of kp_eproc */
+	SK_USAVE,		/* uvar: field of ki_u */
+	SK_RUSAGE,		/* rvar: field of ki_u.u_ru */
+	SK_PCPU,
+	SK_RSS,
+	SK_VSZ,
+	SK_TIME,
+	SK_UTIME,
+	SK_STIME,
+	SK_START,
+	SK_ETIME,
+	SK_PRI,
+	SK_TDEV,
+	SK_USER,		/* effective user name */
+	SK_RUSER,
+	SK_UCOMM,
+	SK_TEXT,		/* whatever the output routine prints */
+};
+
+struct sortkey {
+	VAR	*v;
+	enum sortkind kind;
+	int	desc;
+	int	text;		/* compared as a string */
+};
+
+static struct sortkey sortkeys[SORT_MAXKEYS];
+static int	nsortkeys;
+
+/*
+ * A sort record: the index of the KINFO, then one 64-bit word per key.
+ * Text keys hold a pointer to the string.
+ */
+#define	REC_KEY(r, i)	((r)[1 + (i)])
+
+static size_t	recwords;	/* 1 + nsortkeys */
+
+static enum sortkind
+sort_kind(const VAR *v)
+{
+	static const struct {
+		void	(*oproc)(KINFO *, VARENT *);
+		enum sortkind kind;
+	} kinds[] = {
+		{ pvar, SK_PROC },
+		{ evar, SK_EPROC },
+		{ uvar, SK_USAVE },
+		{ rvar, SK_RUSAGE },
+		{ pcpu, SK_PCPU },
+		{ pmem, SK_RSS },
+		{ p_rssize, SK_RSS },
+		{ vsize, SK_VSZ },
+		{ cputime, SK_TIME },
+		{ putime, SK_UTIME },
+		{ pstime, SK_STIME },
+		{ started, SK_START },
+		{ lstarted, SK_START },
+		{ p_etime, SK_ETIME },
+		{ pri, SK_PRI },
+		{ tname, SK_TDEV },
+		{ longtname, SK_TDEV },
+		{ tdev, SK_TDEV },
+		{ uname, SK_USER },
+		{ logname, SK_USER },
+		{ runame, SK_RUSER },
+		{ ucomm, SK_UCOMM },
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+		if (v->oproc == kinds[i].oproc)
+			return (kinds[i].kind);
+	return (SK_TEXT);
+}
+
+static void
+sort_addkey(const char *name, int desc)
+{
+	struct sortkey *sk;
+	VAR *v;
+
+	if ((v = lookupvar(name)) == NULL)
+		errx(1, "%s: keyword not found", name);
+	if (nsortkeys == SORT_MAXKEYS)
+		errx(1, "too many sort keys");
+	sk = &sortkeys[nsortkeys++];
+	sk->v = v;
+	sk->kind = sort_kind(v);
+	if ((sk->kind == SK_PROC || sk->kind == SK_EPROC ||
+	    sk->kind == SK_USAVE || sk->kind == SK_RUSAGE) &&
+	    (v->type == PGTOK || v->fmt == NULL))
+		sk->kind = SK_TEXT;
+	sk->desc = desc;
+	sk->text = sk->kind == SK_USER || sk->kind == SK_RUSER ||
+	    sk->kind == SK_UCOMM || sk->kind == SK_TEXT;
+}
+
+/*
+ * Set the sort order from a list like "rss,-start".  Replaces any
+ * earlier order.
+ */
+void
+sort_parse(const char *list)
+{
+	char *buf, *p, *name;
+
+	nsortkeys = 0;
+	if ((buf = strdup(list)) == NULL)
+		errx(1, "malloc failed");
+	for (p = buf; (name = strsep(&p, " \t,")) != NULL; ) {
+		if (*name == '\0')
+			continue;
+		if (*name == '-')
+			sort_addkey(name + 1, 1);
+		else
+			sort_addkey(*name == '+' ? name + 1 : name, 0);
+	}
+	free(buf);
+	if (nsortkeys == 0)
+		errx(1, "no sort keys");
+	sort_addkey("pid", 0);
+}
+
+/* Map a signed value to a word with the same unsigned order. */
+static uint64_t
+ordered(int64_t v)
+{
+	return ((uint64_t)v ^ (UINT64_C(1) << 63));
+}
+
+static uint64_t
+typedval(const void *p, enum type type)
+{
+	switch (type) {
+	case CHAR:
+		return (ordered(*(const char *)p));
+	case UCHAR:
+		return (*(const u_char *)p);
+	case SHORT:
+		return (ordered(*(const short *)p));
+	case USHORT:
+		return (*(const u_short *)p);
+	case INT:
+		return (ordered(*(const int *)p));
+	case UINT:
+		return (*(const u_int *)p);
+	case LONG:
+		return (ordered(*(const long *)p));
+	case ULONG:
+	case KPTR:
+		return (*(const u_long *)p);
+	default:
+		return (0);
+	}
+}
+
+static uint64_t
+usecs(const time_value_t *tv)
+{
+	return ((uint64_t)tv->seconds * 1000000 + tv->microseconds);
+}
+
+/*
+ * The text of a column, as its output routine prints it unpadded.
+ */
+static const char *
+sort_text(KINFO *k, VAR *v)
+{
+	static FILE *fp;
+	static char *buf;
+	static size_t size;
+	struct varent ve = { 0 };	/* no next_ve: printed as the last column */
+	FILE *saved;
+	VAR tv;
+	size_t len;
+	char *s, *e;
+
+	if (fp == NULL && (fp = open_memstream(&buf, &size)) == NULL)
+		err(1, "open_memstream");
+	tv = *v;
+	tv.width = 0;
+	ve.header = v->header;
+	ve.var = &tv;
+	rewind(fp);
+	saved = psout;
+	psout = fp;
+	(tv.oproc)(k, &ve);
+	len = (size_t)ftello(fp);
+	(void)fflush(fp);
+	psout = saved;
+
+	for (s = buf, e = buf + len; s < e && *s == ' '; s++)
+		;
+	while (e > s && e[-1] == ' ')
+		e--;
+	return (arena_strndup(curarena, s, e - s));
+}
+
+static uint64_t
+sort_value(KINFO *k, const struct sortkey *sk)
+{
+	struct extern_proc *p;
+	time_value_t tv;
+	VAR *v;
+
+	v = sk->v;
+	p = KI_PROC(k);
+	switch (sk->kind) {
+	case SK_PROC:
+		return (typedval((char *)p + v->off, v->type));
+	case SK_EPROC:
+		return (typedval((char *)KI_EPROC(k) + v->off, v->type));
+	case SK_USAVE:
+		return (k->ki_u.u_valid ?
+		    typedval((char *)&k->ki_u + v->off, v->type) : 0);
+	case SK_RUSAGE:
+		return (k->ki_u.u_valid ?
+		    typedval((char *)&k->ki_u.u_ru + v->off, v->type) : 0);
+	case SK_PCPU:
+		return (ordered(getpcpu(k)));
+	case SK_RSS:
+		return (k->tasks_info.resident_size);
+	case SK_VSZ:
+		return (k->tasks_info.virtual_size);
+	case SK_TIME:
+		tv = k->tasks_info.user_time;
+		time_value_add(&tv, &k->times.user_time);
+		time_value_add(&tv, &k->tasks_info.system_time);
+		time_value_add(&tv, &k->times.system_time);
+		return (usecs(&tv));
+	case SK_UTIME:
+		tv = k->tasks_info.user_time;
+		time_value_add(&tv, &k->times.user_time);
+		return (usecs(&tv));
+	case SK_STIME:
+		tv = k->tasks_info.system_time;
+		time_value_add(&tv, &k->times.system_time);
+		return (usecs(&tv));
+	case SK_START:
+		return (ordered((int64_t)p->p_starttime.tv_sec * 1000000 +
+		    p->p_starttime.tv_usec));
+	case SK_ETIME:
+		/* Longer running means started earlier. */
+		return (~ordered((int64_t)p->p_starttime.tv_sec * 1000000 +
+		    p->p_starttime.tv_usec));
+	case SK_PRI:
+		return (ordered(k->curpri));
+	case SK_TDEV:
+		/* No terminal sorts first, as NODEV (-1) always has. */
+		if (KI_EPROC(k)->e_tdev == NODEV)
+			return (0);
+		return ((uint64_t)KI_EPROC(k)->e_tdev + 1);
+	default:
+		return (0);
+	}
+}
+
+static const char *
+sort_string(KINFO *k, const struct sortkey *sk)
+{
+	const char *s;
+
+	switch (sk->kind) {
+	case SK_USER:
+		s = nc_user(KI_EPROC(k)->e_ucred.cr_uid, 0);
+		break;
+	case SK_RUSER:
+		s = nc_user(KI_EPROC(k)->e_pcred.p_ruid, 0);
+		break;
+	case SK_UCOMM:
+		return (KI_PROC(k)->p_comm);
+	default:
+		return (sort_text(k, sk->v));
+	}
+	/* nc_user() may hand back a static buffer. */
+	return (arena_strdup(curarena, s));
+}
+
+static int
+reccmp(const uint64_t *a, const uint64_t *b)
+{
+	const struct sortkey *sk;
+	int i, c;
+
+	for (i = 0; i < nsortkeys; i++) {
+		sk = &sortkeys[i];
+		if (sk->text)
+			c = strcmp((const char *)(uintptr_t)REC_KEY(a, i),
+			    (const char *)(uintptr_t)REC_KEY(b, i));
+		else
+			c = REC_KEY(a, i) < REC_KEY(b, i) ? -1 :
+			    REC_KEY(a, i) > REC_KEY(b, i);
+		if (c != 0)
+			return (sk->desc ? -c : c);
+	}
+	return (0);
+}
+
+/*
+ * Stable bottom-up merge sort of n record pointers.
+ */
+static void
+merge_sort(uint64_t **v, int n)
+{
+	uint64_t **tmp, **src, **dst, **t;
+	int w, lo, mid, hi, i, j, k;
+
+	tmp = amalloc(n * sizeof(*tmp));
+	src = v;
+	dst = tmp;
+	for (w = 1; w < n; w *= 2) {
+		for (lo = 0; lo < n; lo += 2 * w) {
+			mid = lo + w < n ? lo + w : n;
+			hi = lo + 2 * w < n ? lo + 2 * w : n;
+			i = lo;
+			j = mid;
+			for (k = lo; k < hi; k++) {
+				if (i < mid && (j >= hi ||
+				    reccmp(src[i], src[j]) <= 0))
+					dst[k] = src[i++];
+				else
+					dst[k] = src[j++];
+			}
+		}
+		t = src;
+		src = dst;
+		dst = t;
+	}
+	if (src != v)
+		memcpy(v, src, n * sizeof(*v));
+}
+
+/*
+ * LSD radix sort of n records of recwords words each, all keys numeric.
+ * Descending keys were complemented when the records were built.  Byte
+ * positions in which every record agrees are skipped, which for small
+ * values (pids, most counters) is most of them.  Returns the buffer
+ * holding the result, recs or tmp.
+ */
+static uint64_t *
+radix_sort(uint64_t *recs, uint64_t *tmp, int n)
+{
+	size_t (*count)[256];
+	uint64_t *src, *dst, *r, *t, d;
+	size_t pos[256], off;
+	int key, byte, i, npass;
+
+	npass = nsortkeys * 8;
+	count = acalloc(npass, sizeof(*count));
+	for (i = 0, r = recs; i < n; i++, r += recwords)
+		for (key = 0; key < nsortkeys; key++)
+			for (byte = 0, d = REC_KEY(r, key); byte < 8;
+			    byte++, d >>= 8)
+				count[key * 8 + byte][d & 0xff]++;
+
+	src = recs;
+	dst = tmp;
+	for (key = nsortkeys - 1; key >= 0; key--) {
+		for (byte = 0; byte < 8; byte++) {
+			for (i = 0; i < 256; i++)
+				if (count[key * 8 + byte][i] == (size_t)n)
+					break;
+			if (i < 256)
+				continue;
+			for (off = 0, i = 0; i < 256; i++) {
+				pos[i] = off;
+				off += count[key * 8 + byte][i];
+			}
+			for (i = 0, r = src; i < n; i++, r += recwords) {
+				d = (REC_KEY(r, key) >> (byte * 8)) & 0xff;
+				memcpy(dst + pos[d]++ * recwords, r,
+				    recwords * sizeof(*r));
+			}
+			t = src;
+			src = dst;
+			dst = t;
+		}
+	}
+	return (src);
+}
+
+/*
+ * What has to be collected for a process before its sort keys can be
+ * extracted, as COLLECT_* flags.
+ */
+int
+sort_needs(void)
+{
+	int key, need;
+
+	need = 0;
+	for (key = 0; key < nsortkeys; key++)
+		need |= varcollect(sortkeys[key].v);
+	return (need);
+}
+
+/*
+ * Build the sort record for process k, which is kinfo[i].  Descending
+ * numeric keys are complemented if flip is set.
+ */
+static void
+sort_record(uint64_t *r, KINFO *k, int i, int flip)
+{
+	const struct sortkey *sk;
+	int key;
+
+	r[0] = i;
+	for (key = 0; key < nsortkeys; key++) {
+		sk = &sortkeys[key];
+		if (sk->text)
+			REC_KEY(r, key) = (uintptr_t)sort_string(k, sk);
+		else if (sk->desc && flip)
+			REC_KEY(r, key) = ~sort_value(k, sk);
+		else
+			REC_KEY(r, key) = sort_value(k, sk);
+	}
+}
+
+/*
+ * Return kinfo[0..n-1] in the order set by sort_parse(), as an array of
+ * pointers allocated from the snapshot arena.  The KINFOs themselves are
+ * large and are left where they are.
+ */
+KINFO **
+sort_procs(KINFO *kinfo, int n)
+{
+	uint64_t *recs, *r, **v;
+	KINFO **sorted;
+	int i, key, text;
+
+	sorted = amalloc((n > 0 ? n : 1) * sizeof(*sorted));
+	if (n < 2) {
+		if (n == 1)
+			sorted[0] = &kinfo[0];
+		return (sorted);
+	}
+	recwords = 1 + nsortkeys;
+	recs = amalloc(n * recwords * sizeof(*recs));
+	text = 0;
+	for (key = 0; key < nsortkeys; key++)
+		text |= sortkeys[key].text;
+
+	for (i = 0, r = recs; i < n; i++, r += recwords)
+		sort_record(r, &kinfo[i], i, !text);
+
+	if (text) {
+		v = amalloc(n * sizeof(*v));
+		for (i = 0; i < n; i++)
+			v[i] = recs + i * recwords;
+		merge_sort(v, n);
+		for (i = 0; i < n; i++)
+			sorted[i] = &kinfo[v[i][0]];
+	} else {
+		r = radix_sort(recs, amalloc(n * recwords * sizeof(*recs)), n);
+		for (i = 0; i < n; i++)
+			sorted[i] = &kinfo[r[i * recwords]];
+	}
+	return (sorted);
+}
+
+/*
+ * Sift heap[i] down a heap of n records with the one that sorts last at
+ * the root.
+ */
+static void
+heap_down(uint64_t **heap, int n, int i)
+{
+	uint64_t *t;
+	int c;
+
+	while ((c = 2 * i + 1) < n) {
+		if (c + 1 < n && reccmp(heap[c + 1], heap[c]) > 0)
+			c++;
+		if (reccmp(heap[c], heap[i]) <= 0)
+			break;
+		t = heap[i];
+		heap[i] = heap[c];
+		heap[c] = t;
+		i = c;
+	}
+}
+
+/*
+ * Like sort_procs(), for when only the first top processes in the order
+ * are wanted.  The records are kept in a heap of at most top entries,
+ * the one that sorts last at its root, so each process is compared
+ * against the worst winner so far and the rest are never ordered.  The
+ * winners are moved, in order, to kinfo[0..top-1]; the other KINFOs end
+ * up after them in no particular order.  Expects top < n.
+ */
+KINFO **
+sort_top(KINFO *kinfo, int n, int top)
+{
+	uint64_t *recs, *r, **heap, *t;
+	KINFO **sorted, *win;
+	char *front;
+	int i, j, c, nheap;
+
+	recwords = 1 + nsortkeys;
+	recs = amalloc((top + 1) * recwords * sizeof(*recs));
+	heap = amalloc(top * sizeof(*heap));
+	for (i = 0; i < top; i++)
+		heap[i] = recs + i * recwords;
+	r = recs + top * recwords;		/* the candidate */
+	nheap = 0;
+	for (i = 0; i < n; i++) {
+		sort_record(r, &kinfo[i], i, 0);
+		if (nheap < top) {
+			/* Sift up. */
+			memcpy(heap[nheap], r, recwords * sizeof(*r));
+			for (j = nheap++; j > 0; j = c) {
+				c = (j - 1) / 2;
+				if (reccmp(heap[c], heap[j]) >= 0)
+					break;
+				t = heap[c];
+				heap[c] = heap[j];
+				heap[j] = t;
+			}
+		} else if (reccmp(r, heap[0]) < 0) {
+			memcpy(heap[0], r, recwords * sizeof(*r));
+			heap_down(heap, nheap, 0);
+		}
+	}
+	merge_sort(heap, nheap);
+
+	/*
+	 * Move the winners to the front.  Each one that is not already
+	 * there leaves a slot for one of the losers that are.
+	 */
+	win = amalloc(top * sizeof(*win));
+	front = acalloc(top, 1);
+	for (i = 0; i < top; i++) {
+		win[i] = kinfo[heap[i][0]];
+		if (heap[i][0] < (uint64_t)top)
+			front[heap[i][0]] = 1;
+	}
+	for (i = j = 0; i < top; i++) {
+		if (heap[i][0] < (uint64_t)top)
+			continue;
+		while (front[j])
+			j++;
+		kinfo[heap[i][0]] = kinfo[j++];
+	}
+	memcpy(kinfo, win, top * sizeof(*win));
+
+	sorted = amalloc(top * sizeof(*sorted));
+	for (i = 0; i < top; i++)
+		sorted[i] = &kinfo[i];
+	return (sorted);
+}
+
+/*
+ * --forest: reorder sorted[0..n-1] so that each process is followed by
+ * its descendants, and give each one the tree to draw before its
+ * command.  Children are found through an index of the pids, so this is
+ * linear; siblings, and the roots, keep the order they had.  A process
+ * whose parent was not selected is a root.
+ */
+#define	PID_SLOT(pid, shift) \
+	((size_t)(((uint64_t)(uint32_t)(pid) * 0x9e3779b97f4a7c15ULL) >> (shift)))
+
+void
+sort_forest(KINFO **sorted, int n)
+{
+	KINFO **out;
+	const char **cont;
+	int *index, *first, *last, *next, *parent, *stack;
+	char *done;
+	size_t mask, slot;
+	pid_t pid, ppid;
+	int bits, i, nout, nstack, p, root, start, v;
+
+	if (n < 2)
+		return;
+	/* pid -> position in sorted[], at most half full. */
+	for (bits = 1; ((size_t)1 << bits) < (size_t)n * 2; bits++)
+		;
+	mask = ((size_t)1 << bits) - 1;
+	index = amalloc((mask + 1) * sizeof(*index));
+	memset(index, 0xff, (mask + 1) * sizeof(*index));
+	for (i = 0; i < n; i++) {
+		pid = KI_PROC(sorted[i])->p_pid;
+		for (slot = PID_SLOT(pid, 64 - bits); index[slot] != -1;
+		    slot = (slot + 1) & mask)
+			;
+		index[slot] = i;
+	}
+
+	/* Child lists, in the existing order; the roots are one more. */
+	first = amalloc((n + 1) * sizeof(*first));
+	last = amalloc((n + 1) * sizeof(*last));
+	next = amalloc(n * sizeof(*next));
+	parent = amalloc(n * sizeof(*parent));
+	memset(first, 0xff, (n + 1) * sizeof(*first));
+	root = n;
+	for (i = 0; i < n; i++) {
+		pid = KI_PROC(sorted[i])->p_pid;
+		ppid = KI_EPROC(sorted[i])->e_ppid;
+		p = root;
+		for (slot = PID_SLOT(ppid, 64 - bits); index[slot] != -1;
+		    slot = (slot + 1) & mask)
+			if (KI_PROC(sorted[index[slot]])->p_pid == ppid) {
+				if (ppid != pid)
+					p = index[slot];
+				break;
+			}
+		parent[i] = p;
+		next[i] = -1;
+		if (first[p] == -1)
+			first[p] = i;
+		else
+			next[last[p]] = i;
+		last[p] = i;
+	}
+
+	/*
+	 * Depth first, with the next sibling stacked under the first child.
+	 * cont[] is what the children of a process draw before their own
+	 * branch.  Anything not reached from a root is in a cycle, which a
+	 * snapshot taken while processes are reparented could show; the
+	 * cycle is drawn as a tree from its first member in the order.
+	 */
+	out = amalloc(n * sizeof(*out));
+	cont = amalloc(n * sizeof(*cont));
+	stack = amalloc((n + 1) * sizeof(*stack));
+	done = acalloc(n, 1);
+	nout = 0;
+	for (i = -1; i < n; i++) {
+		nstack = 0;
+		start = -1;
+		if (i == -1) {
+			if (first[root] != -1)
+				stack[nstack++] = first[root];
+		} else if (!done[i])
+			stack[nstack++] = start = i;
+		while (nstack > 0) {
+			v = stack[--nstack];
+			if (done[v])
+				continue;
+			done[v] = 1;
+			out[nout++] = sorted[v];
+			if (next[v] != -1 && v != start)
+				stack[nstack++] = next[v];
+			if (first[v] != -1)
+				stack[nstack++] = first[v];
+			if (parent[v] == root || v == start) {
+				sorted[v]->ki_prefix = NULL;
+				cont[v] = "";
+				continue;
+			}
+			p = parent[v];
+			sorted[v]->ki_prefix = arena_printf(curarena, NULL,
+			    "%s%s", cont[p], next[v] == -1 ? "`-- " : "|-- ");
+			cont[v] = arena_printf(curarena, NULL, "%s%s", cont[p],
+			    next[v] == -1 ? "    " : "|   ");
+		}
+	}
+	memcpy(sorted, out, n * sizeof(*sorted));
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Phase timing and event counters.
+ *
+ * When --stats is given, or PS_STATS is set in the environment, main()
+ * marks the start of each phase with stats_phase() and the process
+ * sources and the arena count their system calls, retries and
+ * allocations with STATS_ADD().  At exit a table is written to stderr.
+ * A PS_FIXTURES build also honours PS_BENCH, which reports one line of
+ * key=value pairs instead, for ps/tests/bench_test.sh.  Otherwise all of
+ * this reduces to a test of psstats.
+ */
+
+#include <sys/types.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ps.h"
+
+int	 psstats;			/* counting is on */
+static int	 statsbench;		/* report for PS_BENCH */
+
+static const char *phasename[ST_NPHASE] = {
+	"fetch", "select", "collect", "size", "sort", "output",
+};
+static const char *countname[ST_NCOUNT] = {
+	"allocs", "alloc_bytes", "syscalls", "sysctl_retries",
+};
+static const char *countdesc[ST_NCOUNT] = {
+	"allocations", "bytes allocated", "system calls",
+	"process table retries",
+};
+
+static double	 phasetime[ST_NPHASE];	/* seconds */
+static int	 curphase = -1;
+static struct timespec phasestart;
+static _Atomic unsigned long counts[ST_NCOUNT];
+
+static void
+stats_report(void)
+{
+	double total;
+	int i;
+
+	/* What is still buffered counts as output. */
+	(void)fflush(stdout);
+	stats_phase(-1);
+	if (statsbench) {
+		for (i = 0; i < ST_NPHASE; i++)
+			(void)fprintf(stderr, "%s%s_ms=%.3f", i == 0 ? "" : " ",
+			    phasename[i], phasetime[i] * 1000.0);
+		for (i = 0; i < ST_NCOUNT; i++)
+			(void)fprintf(stderr, " %s=%lu", countname[i],
+			    atomic_load(&counts[i]));
+		(void)fputc('\n', stderr);
+		return;
+	}
+
+	total = 0;
+	for (i = 0; i < ST_NPHASE; i++)
+		total += phasetime[i];
+	(void)fprintf(stderr, "%-10s %10s %6s\n", "phase", "ms", "%");
+	for (i = 0; i < ST_NPHASE; i++)
+		(void)fprintf(stderr, "%-10s %10.3f %6.1f\n", phasename[i],
+		    phasetime[i] * 1000.0,
+		    total > 0 ? 100.0 * phasetime[i] / total : 0.0);
+	(void)fprintf(stderr, "%-10s %10.3f\n", "total", total * 1000.0);
+	for (i = 0; i < ST_NCOUNT; i++)
+		(void)fprintf(stderr, "%10lu %s\n", atomic_load(&counts[i]),
+		    countdesc[i]);
+}
+
+/*
+ * Turn counting on if report (--stats) is set or the environment asks
+ * for it.
+ */
+void
+stats_init(int report)
+{
+#ifdef PS_FIXTURES
+	if (getenv("PS_BENCH") != NULL)
+		statsbench = 1;
+	else
+#endif
+	if (!report && getenv("PS_STATS") == NULL)
+		return;
+	psstats = 1;
+	(void)atexit(stats_report);
+}
+
+/*
+ * End the current phase and start phase ph (-1 for none).  Time spent in
+ * a phase accumulates, so -W snapshots add up.
+ */
+void
+stats_phase(int ph)
+{
+	struct timespec ts;
+
+	if (!psstats)
+		return;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	if (curphase >= 0)
+		phasetime[curphase] += (ts.tv_sec - phasestart.tv_sec) +
+		    (ts.tv_nsec - phasestart.tv_nsec) / 1e9;
+	curphase = ph;
+	phasestart = ts;
+}
+
+/* Called from any thread, through STATS_ADD(). */
+void
+stats_add(int which, unsigned long n)
+{
+	atomic_fetch_add_explicit(&counts[which], n, memory_order_relaxed);
+}
@@ -14,12 +14,17 @@
 #include <limits.h>
 #include <nlist.h>
 #include <paths.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <locale.h>
 #include <pwd.h>
+#include <libproc.h>
+#include <System/sys/persona.h>
 
 #include "ps.h"
 #include <mach/shared_memory_server.h>
@@ -87,25 +92,17 @@ thread_schedinfo(
 	return(ret);
 }
 
-int get_task_info (KINFO *ki) 
+/*
+ * Task-wide data: sizes, times and scheduling.
+ */
+static int
+task_basic_data(KINFO *ki)
 {
 	kern_return_t   	error;
-	unsigned int		info_count = TASK_BASIC_INFO_COUNT;
-        unsigned int 		thread_info_count = THREAD_BASIC_INFO_COUNT;
-        pid_t				pid;
-	int j, err = 0;
+	unsigned int		info_count;
 
-	ki->state = STATE_MAX;
-
-	pid = KI_PROC(ki)->p_pid;
-    error = task_read_for_pid(mach_task_self(), pid, &ki->task);
-	if (error != KERN_SUCCESS) {
-#ifdef DEBUG
-        mach_error("Error calling task_read_for_pid()", error);
-#endif
-                return(1);
-	}
 	info_count = TASK_BASIC_INFO_COUNT;
+	STATS_ADD(ST_SYSCALLS, 1);
 	 error = task_info(ki->task, TASK_BASIC_INFO, (task_info_t)&ki->tasks_info, &info_count);
 	 if (error != KERN_SUCCESS) {
 		 ki->invalid_tinfo=1;
@@ -126,6 +123,7 @@ int get_task_info (KINFO *ki)
 		 * the 2 segments that are used for split libraries
 		 */
 		info_count = VM_REGION_BASIC_INFO_COUNT_64;
+		STATS_ADD(ST_SYSCALLS, 1);
 		error = mach_vm_region(ki->task, &address, &size, VM_REGION_BASIC_INFO,
 				     (vm_region_info_t)&b_info, &info_count, &object_name);
 	        if (error == KERN_SUCCESS) {
@@ -135,6 +133,7 @@ int get_task_info (KINFO *ki)
 		}
 	}
 	info_count = TASK_THREAD_TIMES_INFO_COUNT;
+	STATS_ADD(ST_SYSCALLS, 1);
         error = task_info(ki->task, TASK_THREAD_TIMES_INFO, (task_info_t)&ki->times, &info_count);
         if (error != KERN_SUCCESS) {
                  ki->invalid_tinfo=1;
@@ -146,6 +145,7 @@ int get_task_info (KINFO *ki)
 	switch(ki->tasks_info.policy) {
 		case POLICY_TIMESHARE :
 		info_count = POLICY_TIMESHARE_INFO_COUNT;
+		STATS_ADD(ST_SYSCALLS, 1);
 		error = task_info(ki->task, TASK_SCHED_TIMESHARE_INFO, (task_info_t)&ki->schedinfo.tshare, &info_count);
 			if (error != KERN_SUCCESS) {
 				ki->invalid_tinfo=1;
@@ -160,6 +160,7 @@ int get_task_info (KINFO *ki)
 			break;
 		case POLICY_RR :
  		info_count = POLICY_RR_INFO_COUNT;
+		STATS_ADD(ST_SYSCALLS, 1);
 		error = task_info(ki->task, TASK_SCHED_RR_INFO, (task_info_t)&ki->schedinfo.rr, &info_count);
 			if (error != KERN_SUCCESS) {
 				ki->invalid_tinfo=1;
@@ -175,6 +176,7 @@ int get_task_info (KINFO *ki)
 
 		case POLICY_FIFO :
   		info_count = POLICY_FIFO_INFO_COUNT;
+		STATS_ADD(ST_SYSCALLS, 1);
 		error = task_info(ki->task, TASK_SCHED_FIFO_INFO, (task_info_t)&ki->schedinfo.fifo, &info_count);
 			if (error != KERN_SUCCESS) {
 				ki->invalid_tinfo=1;
@@ -190,21 +192,33 @@ int get_task_info (KINFO *ki)
 	}
 
 	 ki->invalid_tinfo=0;
+	return(0);
+}
+
+/*
+ * Per-thread data, and the state, usage and priority taken from it.
+ */
+static int
+task_thread_data(KINFO *ki)
+{
+	kern_return_t   	error;
+        unsigned int 		thread_info_count;
+	int j, err = 0;
 
+	ki->state = STATE_MAX;
 	ki->cpu_usage=0;
+	STATS_ADD(ST_SYSCALLS, 1);
 	error = task_threads(ki->task, &ki->thread_list, &ki->thread_count);
 	if (error != KERN_SUCCESS) {
-		mach_port_deallocate(mach_task_self(),ki->task);
 #ifdef DEBUG
 		mach_error("Call to task_threads() failed", error);
 #endif
 		return(1);
 	}
-	err=0;
 	//ki->curpri = 255;
 	//ki->basepri = 255;
     ki->swapped = 1;
-    ki->thval = calloc(ki->thread_count, sizeof(struct thread_values));
+    ki->thval = acalloc(ki->thread_count, sizeof(struct thread_values));
     for (j = 0; j < ki->thread_count; j++) {
         int tstate;
         thread_info_count = THREAD_BASIC_INFO_COUNT;
@@ -237,6 +251,8 @@ int get_task_info (KINFO *ki)
                              ki->thread_list[j]);
     }
     ki->invalid_thinfo = err;
+	/* Two thread_info()s and a deallocation per thread, then the list. */
+	STATS_ADD(ST_SYSCALLS, 3 * ki->thread_count + 1);
 	 /* Deallocate the list of threads. */
     error = vm_deallocate(mach_task_self(),
                           (vm_address_t)(ki->thread_list),
@@ -247,6 +263,283 @@ int get_task_info (KINFO *ki)
 #endif
     }
 
-    mach_port_deallocate(mach_task_self(),ki->task);
     return(0);
 }
+
+/*
+ * Fill in the task data named by what (COLLECT_TASK, COLLECT_THREADS).
+ * The thread walk is the expensive part, so --top leaves it for the
+ * processes that are going to be printed.
+ */
+int get_task_info (KINFO *ki, int what)
+{
+	kern_return_t   	error;
+        pid_t				pid;
+	int err = 0;
+
+	if (what & COLLECT_THREADS)
+		ki->state = STATE_MAX;
+
+	pid = KI_PROC(ki)->p_pid;
+	STATS_ADD(ST_SYSCALLS, 1);
+    error = task_read_for_pid(mach_task_self(), pid, &ki->task);
+	if (error != KERN_SUCCESS) {
+#ifdef DEBUG
+        mach_error("Error calling task_read_for_pid()", error);
+#endif
+                return(1);
+	}
+	if (what & COLLECT_TASK)
+		err = task_basic_data(ki);
+	if (err == 0 && !ki->invalid_tinfo && (what & COLLECT_THREADS))
+		err = task_thread_data(ki);
+
+	STATS_ADD(ST_SYSCALLS, 1);
+    mach_port_deallocate(mach_task_self(),ki->task);
+    return(err);
+}
+
+/*
+ * Reading a table whose size changes while it is read: it is sized,
+ * allocated with FETCH_SLACK() to spare, and read.
+ */
+#define	FETCH_SLACK(n)	((n) / 8 + 16384)
+#define	FETCH_RETRIES	1000
+#define	FETCH_BACKOFF	10		/* first wait after an error, in us */
+#define	FETCH_MAXWAIT	100000		/* longest single wait, in us */
+#define	FETCH_BUDGET	2000000		/* all the waiting, in us */
+
+static uint64_t
+fetch_clock(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/*
+ * Read the sysctl named by mib into a buffer the caller frees, setting
+ * *sizep to the bytes read.  If the table outgrew the buffer (ENOMEM),
+ * it is sized and read again at once; other errors are retried after a
+ * wait that starts at FETCH_BACKOFF and doubles.  Either way it gives
+ * up after FETCH_RETRIES retries or FETCH_BUDGET of wall-clock time.
+ * If the last read still found the buffer too small, the buffer holds
+ * the start of the table, as much as the kernel copied out; that is
+ * returned and *partial set.  Otherwise giving up returns NULL with
+ * errno set.
+ */
+static void *
+sysctl_fetch(int *mib, u_int miblen, size_t *sizep, int *partial)
+{
+	uint64_t deadline, now_us, wait;
+	size_t size, want;
+	char *buf, *nbuf;
+	int error, retry;
+
+	*partial = 0;
+	buf = NULL;
+	want = 0;
+	wait = FETCH_BACKOFF;
+	deadline = fetch_clock() + FETCH_BUDGET;
+	for (retry = 0; ; retry++) {
+		error = 0;
+		if (want == 0) {
+			STATS_ADD(ST_SYSCALLS, 1);
+			if (sysctl(mib, miblen, NULL, &size, NULL, 0) == -1)
+				error = errno;
+			else {
+				want = size + FETCH_SLACK(size);
+				if ((nbuf = realloc(buf, want)) == NULL) {
+					free(buf);
+					errno = ENOMEM;
+					return (NULL);
+				}
+				buf = nbuf;
+			}
+		}
+		if (error == 0) {
+			size = want;
+			STATS_ADD(ST_SYSCALLS, 1);
+			if (sysctl(mib, miblen, buf, &size, NULL, 0) == 0) {
+				*sizep = size;
+				return (buf);
+			}
+			error = errno;
+		}
+
+		now_us = fetch_clock();
+		if (retry == FETCH_RETRIES || now_us >= deadline) {
+			if (error == ENOMEM && buf != NULL && want > 0) {
+				/* On ENOMEM, size is what was copied out. */
+				*sizep = size < want ? size : want;
+				*partial = 1;
+				return (buf);
+			}
+			free(buf);
+			errno = error;
+			return (NULL);
+		}
+		STATS_ADD(ST_RETRIES, 1);
+		if (error == ENOMEM) {
+			/* It grew: size it again. */
+			want = 0;
+			continue;
+		}
+		if (wait > deadline - now_us)
+			wait = deadline - now_us;
+		(void)usleep((useconds_t)wait);
+		if ((wait *= 2) > FETCH_MAXWAIT)
+			wait = FETCH_MAXWAIT;
+	}
+}
+
+/*
+ * Fetch the process table with sysctl(KERN_PROC).
+ */
+static struct kinfo_proc *
+sysctl_getprocs(int what, int flag, int *nentries)
+{
+	struct kinfo_proc *kp;
+	int mib[4] = { CTL_KERN, KERN_PROC, what, flag };
+	size_t size;
+	int partial;
+
+	if ((kp = sysctl_fetch(mib, 4, &size, &partial)) == NULL) {
+		perror("Failure calling sysctl");
+		return (NULL);
+	}
+	if (partial) {
+		warnx("process table kept growing; the list is incomplete");
+		eval = 1;
+	}
+	*nentries = size / sizeof(struct kinfo_proc);
+	return (kp);
+}
+
+/*
+ * Get the raw argument space of the process with sysctl(KERN_PROCARGS2).
+ * The layout is documented in start.s, which is part of the Csu
+ * project.  In summary, it looks like:
+ *
+ * /---------------\ 0x00000000
+ * :               :
+ * :               :
+ * |---------------|
+ * | argc          |
+ * |---------------|
+ * | arg[0]        |
+ * |---------------|
+ * :               :
+ * :               :
+ * |---------------|
+ * | arg[argc - 1] |
+ * |---------------|
+ * | 0             |
+ * |---------------|
+ * | env[0]        |
+ * |---------------|
+ * :               :
+ * :               :
+ * |---------------|
+ * | env[n]        |
+ * |---------------|
+ * | 0             |
+ * |---------------| <-- Beginning of data returned by sysctl() is here.
+ * | argc          |
+ * |---------------|
+ * | exec_path     |
+ * |:::::::::::::::|
+ * |               |
+ * | String area.  |
+ * |               |
+ * |---------------| <-- Top of stack.
+ * :               :
+ * :               :
+ * \---------------/ 0xffffffff
+ */
+static int argmax;
+
+static void
+sysctl_argmax(void)
+{
+	int mib[2];
+	size_t size;
+
+	mib[0] = CTL_KERN;
+	mib[1] = KERN_ARGMAX;
+
+	size = sizeof(argmax);
+	if (sysctl(mib, 2, &argmax, &size, NULL, 0) == -1)
+		argmax = 0;
+}
+
+static char *
+sysctl_procargs(KINFO *ki, size_t *sizep)
+{
+	static pthread_once_t argmax_once = PTHREAD_ONCE_INIT;
+	static __thread char *argbuf;	/* KERN_ARGMAX bytes, per thread */
+	int mib[3];
+	size_t size;
+	char *procargs;
+
+	/* Get the maximum process arguments size; it does not change. */
+	(void)pthread_once(&argmax_once, sysctl_argmax);
+	if (argmax == 0)
+		return (NULL);
+
+	/* Allocate space for the arguments, once per thread. */
+	if (argbuf == NULL && (argbuf = malloc(argmax)) == NULL)
+		return (NULL);
+
+	mib[0] = CTL_KERN;
+	mib[1] = KERN_PROCARGS2;
+	mib[2] = KI_PROC(ki)->p_pid;
+
+	size = (size_t)argmax;
+	STATS_ADD(ST_SYSCALLS, 1);
+	if (sysctl(mib, 3, argbuf, &size, NULL, 0) == -1)
+		return (NULL);
+
+	/* Keep only what the process actually has. */
+	procargs = amalloc(size);
+	memcpy(procargs, argbuf, size);
+	*sizep = size;
+	return (procargs);
+}
+
+static int
+sysctl_pidinfo(KINFO *ki, int src, void *buf)
+{
+	struct kpersona_info info = { 0 };
+	pid_t pid;
+	int ret;
+
+	pid = KI_PROC(ki)->p_pid;
+	STATS_ADD(ST_SYSCALLS, 1);
+	switch (src) {
+	case SRC_WQ:
+		ret = proc_pidinfo(pid, PROC_PIDWORKQUEUEINFO, 0, buf,
+		    sizeof(struct proc_workqueueinfo));
+		if (ret != sizeof(struct proc_workqueueinfo) ||
+		    ret != PROC_PIDWORKQUEUEINFO_SIZE)
+			return (-1);
+		return (0);
+	case SRC_PERSONA:
+		info.persona_info_version = PERSONA_INFO_V1;
+		if (kpersona_pidinfo(pid, &info) != 0)
+			return (-1);
+		*(uint32_t *)buf = info.persona_id;
+		return (0);
+	default:
+		return (-1);
+	}
+}
+
+const PROCSOURCE sysctl_source = {
+	"sysctl",
+	sysctl_getprocs,
+	get_task_info,
+	sysctl_procargs,
+	sysctl_pidinfo,
+};
@@ -0,0 +1,105 @@
+#!/bin/sh
+#
+# Run ps against synthetic process tables of increasing size and report
+# the time spent in each phase, with allocation and system call counts.
+#
+#	sh bench_test.sh [ps_bench]
+#
+# BENCH_SIZES, BENCH_ARGS and BENCH_THREADS override the table sizes,
+# bytes of arguments per process and threads per process.  Each run is
+# also checked for the expected number of rows, so that a broken build
+# fails rather than looking fast, each --top run for the same rows as
+# sorting the whole table, each --stream run for every row, and each
+# table is also saved with --save and rendered again with --load, which
+# must give the same output.
+#
+# The synthetic tables need a ps built with -DPS_FIXTURES and fixture.c:
+# the ps_bench target, or the one Makefile.linux builds.  Any other ps,
+# such as the installed one, is a failure rather than a skip, so that a
+# broken bench build cannot pass unnoticed.
+
+ps=${1:-ps_bench}
+sizes=${BENCH_SIZES:-"1000 10000 100000"}
+args=${BENCH_ARGS:-128}
+threads=${BENCH_THREADS:-4}
+fmt="pid,ppid,user,stat,tt,%cpu,%mem,vsz,rss,time,command"
+stdout="stdout-bench.txt"
+stderr="stderr-bench.txt"
+expected="expected-bench.txt"
+snap="snap-bench.bin"
+fails=0
+
+if [ "$(PS_FIXTURE="procs=3" $ps -ax -o pid= 2>/dev/null | wc -l)" -ne 3 ]
+then
+	1>&2 echo "$ps was built without PS_FIXTURES"
+	exit 1
+fi
+
+for n in $sizes; do
+	for jobs in 1 4; do
+		PS_FIXTURE="procs=$n,args=$args,threads=$threads" PS_BENCH=1 \
+		    $ps -ax -J $jobs -o $fmt >$stdout 2>$stderr
+		ret=$?
+		rows=$(($(wc -l <$stdout) - 1))
+
+		if [ $ret -ne 0 ] || [ $rows -ne $n ]; then
+			fails=$((fails + 1))
+			1>&2 echo "ps failed on $n processes" \
+			    "(exit $ret, $rows rows)"
+			1>&2 cat $stderr
+			continue
+		fi
+		echo "procs=$n jobs=$jobs $(tail -n 1 $stderr)"
+	done
+
+	PS_FIXTURE="procs=$n,args=$args,threads=$threads" \
+	    $ps -ax -r -o $fmt 2>/dev/null | head -n 21 >$expected
+	PS_FIXTURE="procs=$n,args=$args,threads=$threads" PS_BENCH=1 \
+	    $ps -ax -r --top 20 -o $fmt >$stdout 2>$stderr
+	ret=$?
+	if [ $ret -ne 0 ] || ! cmp -s $stdout $expected; then
+		fails=$((fails + 1))
+		1>&2 echo "ps --top 20 failed on $n processes (exit $ret)"
+		1>&2 diff $expected $stdout
+		continue
+	fi
+	echo "procs=$n top=20 $(tail -n 1 $stderr)"
+
+	PS_FIXTURE="procs=$n,args=$args,threads=$threads" PS_BENCH=1 \
+	    $ps -ax --stream -o $fmt >$stdout 2>$stderr
+	ret=$?
+	rows=$(($(wc -l <$stdout) - 1))
+	if [ $ret -ne 0 ] || [ $rows -ne $n ]; then
+		fails=$((fails + 1))
+		1>&2 echo "ps --stream failed on $n processes" \
+		    "(exit $ret, $rows rows)"
+		1>&2 cat $stderr
+		continue
+	fi
+	echo "procs=$n stream $(tail -n 1 $stderr)"
+
+	PS_FIXTURE="procs=$n,args=$args,threads=$threads" \
+	    $ps -ax -o $fmt >$expected 2>/dev/null
+	PS_FIXTURE="procs=$n,args=$args,threads=$threads" \
+	    $ps -ax --save $snap 2>$stderr &&
+	    PS_BENCH=1 $ps --load $snap -ax -o $fmt >$stdout 2>$stderr
+	ret=$?
+	if [ $ret -ne 0 ] || ! cmp -s $stdout $expected; then
+		fails=$((fails + 1))
+		1>&2 echo "ps --load failed on $n processes (exit $ret)"
+		1>&2 cat $stderr
+		1>&2 diff $expected $stdout | head -n 20
+		continue
+	fi
+	echo "procs=$n load $(tail -n 1 $stderr)"
+done
+
+rm -f "$stdout" "$stderr" "$expected" "$snap"
+
+if [ $fails -eq 0 ]; then
+	echo "All benchmarks ran."
+else
+	1>&2 echo "$fails benchmarks failed"
+fi
+
+exit $fails
@@ -0,0 +1,52 @@
+#!/bin/sh
+
+fails=0
+ps="ps"
+outfile="ps-forest.txt"
+
+fail() {
+	1>&2 echo "$ps --forest: $1"
+	fails=$((fails + 1))
+}
+
+sh -c 'sleep 37 & sleep 37 & wait' &
+pid=$!
+sleep 0.3
+
+# The parent's row and the two after it, as "ppid command".
+$ps -ax --forest -o pid= -o ppid= -o command= |
+    awk -v pid=$pid '$1 == pid { n = 3 }
+	n > 0 { n--; sub(/^ *[0-9]+ +/, ""); print }' > "$outfile"
+
+parent=$(sed -n 1p "$outfile")
+child1=$(sed -n 2p "$outfile")
+child2=$(sed -n 3p "$outfile")
+
+# Each child's prefix continues its parent's: "|-- " becomes "|   ", and
+# "`-- " becomes four blanks.
+prefix=${parent#* }
+prefix=${prefix%sh -c sleep 37 & sleep 37 & wait}
+case "$prefix" in
+*'|-- ')	indent="${prefix%|-- }|   " ;;
+*'`-- ')	indent="${prefix%\`-- }    " ;;
+*)		indent="$prefix" ;;
+esac
+
+if [ "${parent#* }" != "${prefix}sh -c sleep 37 & sleep 37 & wait" ]; then
+	fail "parent not found: '$parent'"
+elif [ "$child1" != "$pid ${indent}|-- sleep 37" ]; then
+	fail "expected '$pid ${indent}|-- sleep 37' next, got '$child1'"
+elif [ "$child2" != "$pid ${indent}\`-- sleep 37" ]; then
+	fail "expected '$pid ${indent}\`-- sleep 37' last, got '$child2'"
+fi
+
+kill $pid $($ps -ax -o pid= -o ppid= | awk -v pid=$pid '$2 == pid { print $1 }')
+rm -f "$outfile"
+
+if [ $fails -eq 0 ]; then
+	echo "All tests passed."
+else
+	1>&2 echo "$fails tests failed"
+fi
+
+exit $fails
@@ -0,0 +1,66 @@
+#!/bin/sh
+
+fails=0
+ps="ps"
+tab=$(printf '\t')
+outfile="ps-format.txt"
+expfile="ps-format-expected.txt"
+
+fail() {
+	1>&2 echo "$ps --format=$1: $2"
+	fails=$((fails + 1))
+}
+
+# A process whose arguments need quoting in every format: a comma, double
+# quotes, a tab and a backslash.
+sh -c 'sleep 10; exit 0' "a,b \"q\"${tab}t\\x" &
+pid=$!
+sleep 0.3
+
+out=$($ps --format=json -p $pid -o pid,comm,command)
+exp='{"PID":'$pid',"COMM":"sh","COMMAND":"sh -c sleep 10; exit 0 a,b \"q\"\tt\\x"}'
+if [ "$out" != "$exp" ]; then
+	fail json "expected '$exp', got '$out'"
+fi
+
+# Numbers are bare, strings quoted.
+out=$($ps --format=json -p $pid -o rss,%cpu,user)
+if ! echo "$out" | grep -Eq '^\{"RSS":[0-9]+,"%CPU":[0-9.]+,"USER":"[^"]+"\}$'
+then
+	fail json "badly typed values in '$out'"
+fi
+
+# RFC 4180 records end in CRLF.
+out=$($ps --format=csv -p $pid -o pid,comm,command)
+exp=$(printf '%s\r\n' "PID,COMM,COMMAND" \
+    "$pid,sh,\"sh -c sleep 10; exit 0 a,b \"\"q\"\"${tab}t\\x\"")
+if [ "$out" != "$exp" ]; then
+	fail csv "expected '$exp', got '$out'"
+fi
+
+out=$($ps --format=tsv -p $pid -o pid,comm,command)
+exp=$(printf '%s\n' "PID${tab}COMM${tab}COMMAND" \
+    "$pid${tab}sh${tab}sh -c sleep 10; exit 0 a,b \"q\"\\tt\\\\x")
+if [ "$out" != "$exp" ]; then
+	fail tsv "expected '$exp', got '$out'"
+fi
+
+# Big-endian field count, then a big-endian length before each field.
+$ps --format=bin -p $pid -o pid,comm > "$outfile"
+printf "\\0\\0\\0\\02\\0\\0\\0\\03PID\\0\\0\\0\\04COMM" > "$expfile"
+printf "\\0\\0\\0\\02\\0\\0\\0\\0${#pid}%s\\0\\0\\0\\02sh" $pid >> "$expfile"
+if ! cmp -s "$outfile" "$expfile"; then
+	fail bin "unexpected output"
+	1>&2 od -c "$outfile"
+fi
+
+kill $pid
+rm -f "$outfile" "$expfile"
+
+if [ $fails -eq 0 ]; then
+	echo "All tests passed."
+else
+	1>&2 echo "$fails tests failed"
+fi
+
+exit $fails
@@ -0,0 +1,71 @@
+#!/bin/sh
+
+fails=0
+ps="ps"
+snap="ps-snap.bin"
+short="ps-snap-short.bin"
+outfile="ps-snap.txt"
+expfile="ps-snap-expected.txt"
+errfile="ps-snap-err.txt"
+
+fail() {
+	1>&2 echo "$ps $1"
+	fails=$((fails + 1))
+}
+
+# The rows of these processes, which stay put while ps runs.  Column
+# widths follow the widest value in the whole table, so blanks are
+# squeezed.
+rows() {
+	awk -v pids=",$pids," 'index(pids, "," $1 ",") { $1 = $1; print }'
+}
+
+pids=
+for i in 1 2 3; do
+	sh -c 'sleep 30; exit 0' "arg $i" &
+	pids="$pids,$!"
+done
+pids=${pids#,}
+sleep 0.3
+
+fmt="pid,ppid,user,stat,tt,command"
+$ps -ax -o $fmt | rows > "$expfile"
+if ! $ps -ax --save "$snap"; then
+	fail "-ax --save failed"
+fi
+
+$ps --load "$snap" -ax -o $fmt | rows > "$outfile"
+if [ $(wc -l < "$expfile") -ne 3 ] || ! cmp -s "$outfile" "$expfile"; then
+	fail "--load -ax: output differs from the live one"
+	1>&2 diff "$expfile" "$outfile"
+fi
+
+$ps --load "$snap" -p $pids -o $fmt | rows > "$outfile"
+if ! cmp -s "$outfile" "$expfile"; then
+	fail "--load -p: output differs from the live one"
+	1>&2 diff "$expfile" "$outfile"
+fi
+
+# Cut the snapshot short, partway through its records.
+size=$(wc -c < "$snap")
+head -c $((size - 7)) "$snap" > "$short"
+$ps --load "$short" -ax -o pid > "$outfile" 2> "$errfile"
+rc=$?
+if [ $rc -eq 0 ]; then
+	fail "--load of a truncated snapshot succeeded"
+elif ! grep -q 'snapshot is truncated or corrupt' "$errfile"; then
+	fail "--load of a truncated snapshot: unexpected error"
+	1>&2 cat "$errfile"
+fi
+
+kill $(echo $pids | tr , ' ') $($ps -ax -o pid= -o ppid= |
+    awk -v pids=",$pids," 'index(pids, "," $2 ",") { print $1 }')
+rm -f "$snap" "$short" "$outfile" "$expfile" "$errfile"
+
+if [ $fails -eq 0 ]; then
+	echo "All tests passed."
+else
+	1>&2 echo "$fails tests failed"
+fi
+
+exit $fails
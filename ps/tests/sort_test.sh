@@ -0,0 +1,62 @@
+#!/bin/sh
+
+fails=0
+ps="ps"
+outfile="ps-sort.txt"
+expfile="ps-sort-expected.txt"
+
+fail() {
+	1>&2 echo "$ps $1"
+	fails=$((fails + 1))
+}
+
+# Descending pids, across the whole table.
+$ps -ax --sort=-pid,comm -o pid= > "$outfile"
+if [ ! -s "$outfile" ] || ! sort -c -r -n "$outfile"; then
+	fail "-ax --sort=-pid,comm: not in descending order"
+fi
+
+# --top n is the first n rows of the full sort.  Sort a fixed set of
+# processes, so that the two runs see the same table: four sleeps, and
+# four shells each waiting on a sleep of its own.
+pids=
+for i in 1 2 3 4; do
+	sleep 30 &
+	pids="$pids,$!"
+	sh -c 'sleep 30; exit 0' &
+	pids="$pids,$!"
+done
+pids=${pids#,}
+sleep 0.3
+
+for keys in -pid comm,-pid -comm,pid; do
+	$ps -p $pids --sort=$keys -o pid,comm | head -n 6 > "$expfile"
+	$ps -p $pids --top 5 --sort=$keys -o pid,comm > "$outfile"
+	if [ $(wc -l < "$expfile") -ne 6 ]; then
+		fail "-p $pids --sort=$keys: expected 8 processes"
+		1>&2 cat "$expfile"
+	elif ! cmp -s "$outfile" "$expfile"; then
+		fail "--top 5 --sort=$keys: not the first 5 rows"
+		1>&2 diff "$expfile" "$outfile"
+	fi
+done
+
+# Low pids are long-lived, so --top agrees with the full sort of -ax.
+$ps -ax --sort=pid -o pid,ppid,comm | head -n 6 > "$expfile"
+$ps -ax --top 5 --sort=pid -o pid,ppid,comm > "$outfile"
+if ! cmp -s "$outfile" "$expfile"; then
+	fail "-ax --top 5 --sort=pid: not the first 5 rows"
+	1>&2 diff "$expfile" "$outfile"
+fi
+
+kill $(echo $pids | tr , ' ') $($ps -ax -o pid= -o ppid= |
+    awk -v pids=",$pids," 'index(pids, "," $2 ",") { print $1 }')
+rm -f "$outfile" "$expfile"
+
+if [ $fails -eq 0 ]; then
+	echo "All tests passed."
+else
+	1>&2 echo "$fails tests failed"
+fi
+
+exit $fails
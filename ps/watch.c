@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+ * Reserved.  This file contains Original Code and/or Modifications of
+ * Original Code as defined in and that are subject to the Apple Public
+ * Source License Version 1.0 (the 'License').  You may not use this file
+ * except in compliance with the License.  Please obtain a copy of the
+ * License at http://www.apple.com/publicsource and read it before using
+ * this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License."
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Watch mode (-W).
+ *
+ * ps keeps its format, its KINFO array and a little per-process state
+ * between snapshots instead of being re-run from scratch:
+ *
+ *  - the argument area and rendered command strings of a process are
+ *    carried over to the next snapshot as long as the same process (pid
+ *    and start time) is still there.  Snapshots alternate between two
+ *    arenas (see main()), so the previous snapshot's copies are still
+ *    valid while they are carried into the current one;
+ *  - %cpu is the CPU time used since the previous snapshot divided by the
+ *    wall time between them, rather than the kernel's decayed estimate;
+ *  - each frame is rendered into memory and only the lines that differ
+ *    from the previous frame are rewritten on the terminal.
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ps.h"
+
+struct wproc {
+	pid_t		pid;
+	struct timeval	start;
+	uint64_t	cputime;	/* user + system, microseconds */
+	char		*procargs;
+	size_t		procargsize;
+	int		procargsok;
+	char		*cmdstr[4];
+	int		cmdlen[4];
+};
+
+static struct wproc *wprev;		/* previous snapshot, by pid */
+static int	 nwprev;
+static uint64_t	 wprev_time;		/* when it was taken */
+static uint64_t	 wcur_time;		/* when this one was taken */
+
+static char	*framebuf;		/* frame being rendered */
+static size_t	 framelen;
+static FILE	*framefp;
+static char	**lines;		/* frame currently on the terminal */
+static int	 nlines;
+static int	 painted;
+
+static uint64_t
+watch_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static uint64_t
+watch_cputime(KINFO *k)
+{
+	time_value_t total_time, system_time;
+
+	total_time = k->tasks_info.user_time;
+	system_time = k->tasks_info.system_time;
+
+	time_value_add(&total_time, &k->times.user_time);
+	time_value_add(&system_time, &k->times.system_time);
+	time_value_add(&total_time, &system_time);
+
+	return ((uint64_t)total_time.seconds * 1000000 +
+	    total_time.microseconds);
+}
+
+static int
+wproc_cmp(const void *a, const void *b)
+{
+	pid_t pa = ((const struct wproc *)a)->pid;
+	pid_t pb = ((const struct wproc *)b)->pid;
+
+	return (pa < pb ? -1 : pa > pb);
+}
+
+/*
+ * The previous snapshot's entry for the process behind k, if it is the
+ * same process and not just a recycled pid.
+ */
+static struct wproc *
+watch_lookup(KINFO *k)
+{
+	struct wproc key, *w;
+
+	if (nwprev == 0)
+		return (NULL);
+	key.pid = KI_PROC(k)->p_pid;
+	w = bsearch(&key, wprev, nwprev, sizeof(*wprev), wproc_cmp);
+	if (w == NULL ||
+	    w->start.tv_sec != KI_PROC(k)->p_starttime.tv_sec ||
+	    w->start.tv_usec != KI_PROC(k)->p_starttime.tv_usec)
+		return (NULL);
+	return (w);
+}
+
+/*
+ * Copy the cached argument area and command strings from the previous
+ * snapshot into the current one for the processes that are still around.
+ * Called before collect_procs(), so they are not fetched again.
+ */
+void
+watch_carry(KINFO *kinfo, int n)
+{
+	struct wproc *w;
+	KINFO *k;
+	int i, j;
+
+	for (i = 0; i < n; i++) {
+		k = &kinfo[i];
+		if ((w = watch_lookup(k)) == NULL || w->procargsok == 0)
+			continue;
+		if (w->procargs != NULL) {
+			k->ki_procargs = amalloc(w->procargsize);
+			memcpy(k->ki_procargs, w->procargs, w->procargsize);
+		}
+		k->ki_procargsize = w->procargsize;
+		k->ki_procargsok = w->procargsok;
+		for (j = 0; j < 4; j++) {
+			if (w->cmdstr[j] == NULL)
+				continue;
+			k->ki_cmdstr[j] = arena_strndup(curarena, w->cmdstr[j],
+			    w->cmdlen[j]);
+			k->ki_cmdlen[j] = w->cmdlen[j];
+		}
+	}
+}
+
+/*
+ * Replace each process's CPU usage with the share of one CPU it used
+ * since the previous snapshot.  Processes that are new since then keep
+ * the estimate from the process source.
+ */
+void
+watch_cpu(KINFO *kinfo, int n)
+{
+	struct wproc *w;
+	uint64_t now, elapsed, cputime;
+	KINFO *k;
+	int i;
+
+	wcur_time = now = watch_now();
+	elapsed = now - wprev_time;
+	if (nwprev == 0 || elapsed == 0)
+		return;
+	for (i = 0; i < n; i++) {
+		k = &kinfo[i];
+		if ((w = watch_lookup(k)) == NULL)
+			continue;
+		cputime = watch_cputime(k);
+		if (cputime < w->cputime)
+			cputime = w->cputime;
+		k->cpu_usage = (int)((cputime - w->cputime) *
+		    TH_USAGE_SCALE / elapsed);
+	}
+}
+
+/*
+ * Remember this snapshot for the next one.  The argument area and command
+ * strings are only referenced; they stay in this snapshot's arena until
+ * the one after next.
+ */
+void
+watch_save(KINFO *kinfo, int n)
+{
+	static int nwalloc;
+	struct wproc *w;
+	KINFO *k;
+	int i, j;
+
+	if (n > nwalloc) {
+		free(wprev);
+		if ((wprev = malloc(n * sizeof(*wprev))) == NULL)
+			errx(1, "malloc failed");
+		nwalloc = n;
+	}
+	for (i = 0; i < n; i++) {
+		k = &kinfo[i];
+		w = &wprev[i];
+		w->pid = KI_PROC(k)->p_pid;
+		w->start = KI_PROC(k)->p_starttime;
+		w->cputime = watch_cputime(k);
+		w->procargs = k->ki_procargs;
+		w->procargsize = k->ki_procargsize;
+		w->procargsok = k->ki_procargsok;
+		for (j = 0; j < 4; j++) {
+			w->cmdstr[j] = k->ki_cmdstr[j];
+			w->cmdlen[j] = k->ki_cmdlen[j];
+		}
+	}
+	nwprev = n;
+	qsort(wprev, nwprev, sizeof(*wprev), wproc_cmp);
+	wprev_time = wcur_time != 0 ? wcur_time : watch_now();
+}
+
+/*
+ * Start a frame; the output routines write to the returned stream.
+ */
+FILE *
+watch_begin(void)
+{
+	if ((framefp = open_memstream(&framebuf, &framelen)) == NULL)
+		err(1, "open_memstream");
+	return (framefp);
+}
+
+/*
+ * Write ncols columns' worth of line to stdout.
+ */
+static void
+watch_putline(const char *line, int ncols)
+{
+	const char *cp;
+
+	if (ncols <= 0) {
+		(void)fputs(line, stdout);
+		return;
+	}
+	for (cp = line; *cp != '\0'; cp++) {
+		/* UTF-8 continuation bytes don't take a column. */
+		if ((*cp & 0xc0) != 0x80 && --ncols < 0)
+			break;
+		(void)putchar(*cp);
+	}
+}
+
+/*
+ * Finish the frame and put it on the screen.  On a terminal only lines
+ * that changed are redrawn; otherwise whole frames are written one after
+ * the other, separated by a blank line.
+ */
+void
+watch_end(void)
+{
+	struct winsize ws;
+	char **nl, *cp, *ep;
+	int i, n, rows, cols, tty;
+
+	if (fclose(framefp) != 0)
+		err(1, "frame");
+	framefp = NULL;
+
+	tty = isatty(STDOUT_FILENO);
+	if (!tty) {
+		if (painted++)
+			(void)putchar('\n');
+		(void)fwrite(framebuf, 1, framelen, stdout);
+		free(framebuf);
+		framebuf = NULL;
+		(void)fflush(stdout);
+		return;
+	}
+
+	rows = cols = 0;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, (char *)&ws) == 0) {
+		rows = ws.ws_row;
+		cols = ws.ws_col;
+	}
+
+	/* Split the frame into lines, keeping the last screen row free. */
+	for (n = 0, cp = framebuf; cp < framebuf + framelen; cp = ep + 1, n++)
+		if ((ep = memchr(cp, '\n', framebuf + framelen - cp)) == NULL)
+			break;
+	if (rows > 1 && n > rows - 1)
+		n = rows - 1;
+	if ((nl = calloc(n + 1, sizeof(*nl))) == NULL)
+		errx(1, "malloc failed");
+	for (i = 0, cp = framebuf; i < n; i++, cp = ep + 1) {
+		ep = memchr(cp, '\n', framebuf + framelen - cp);
+		if ((nl[i] = strndup(cp, ep - cp)) == NULL)
+			errx(1, "malloc failed");
+	}
+	free(framebuf);
+	framebuf = NULL;
+
+	if (!painted++)
+		(void)fputs("\033[H\033[2J", stdout);
+	for (i = 0; i < n; i++) {
+		if (i < nlines && strcmp(nl[i], lines[i]) == 0)
+			continue;
+		(void)printf("\033[%d;1H", i + 1);
+		watch_putline(nl[i], cols);
+		(void)fputs("\033[K", stdout);
+	}
+	if (n < nlines)
+		(void)printf("\033[%d;1H\033[J", n + 1);
+	(void)printf("\033[%d;1H", n + 1);
+	(void)fflush(stdout);
+
+	for (i = 0; i < nlines; i++)
+		free(lines[i]);
+	free(lines);
+	lines = nl;
+	nlines = n;
+}
+
+/*
+ * Sleep until interval seconds after the previous snapshot was taken.
+ */
+void
+watch_wait(double interval)
+{
+	struct timespec ts;
+	uint64_t due, now;
+
+	due = wprev_time + (uint64_t)(interval * 1000000);
+	now = watch_now();
+	if (due <= now)
+		return;
+	ts.tv_sec = (due - now) / 1000000;
+	ts.tv_nsec = (due - now) % 1000000 * 1000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}